@@ -65,7 +65,7 @@ int main() {
     // ============================================
     char buffer[1024] = {0}; // 准备一个缓冲区放数据
     int valread = read(new_socket, buffer, 1024);
-    cout << "收到消息: " << buffer << endl;
+    cout << "收到消息 (" << valread << " 字节): " << buffer << endl;
 
     // ============================================
     // 第六步：关闭连接 (挂断)
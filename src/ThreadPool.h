@@ -2,48 +2,240 @@
 #define THREAD_POOL_H
 
 #include <vector>
-#include <queue>
+#include <deque>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
 #include <condition_variable>
 #include <functional>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "task_queue.h"
 
+// 工作窃取线程池：每个 worker 一个自己的任务队列，提交时轮流分给各个 worker，
+// 自己的队列空了就去别的 worker 队列里偷任务，都没有才睡眠
+// 任务是不分配内存的 Task，队列是有界无锁 MPMC 环：worker 醒着时，loop 线程交一个任务给它
+// 只是几次 cache line 传递，没有 malloc 也没有 futex；只有叫醒睡着的 worker 才进内核
 class ThreadPool {
 public:
-    ThreadPool(size_t threads) : stop(false) {
-        for(size_t i = 0; i < threads; ++i)
-            workers.emplace_back([this] {
-                while(true) {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock, [this]{ return this->stop || !this->tasks.empty(); });
-                        if(this->stop && this->tasks.empty()) return;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                    }
-                    task();
-                }
+    static const int SPIN_ROUNDS = 64;          // 默认睡眠前空转找任务的轮数，可以在构造时指定
+    static const size_t QUEUE_SIZE = 4096;      // 每个 worker 环形队列的容量 (2 的幂)
+
+    // spin_rounds：空转轮数，0 表示不空转直接睡；负载高、核多时调大可以少进几次 futex
+    // on_start：每个 worker 线程开始取任务前调用一次 (参数是 worker 编号)，用来绑核
+    ThreadPool(size_t threads, int spin_rounds = SPIN_ROUNDS,
+               std::function<void(size_t)> on_start = nullptr)
+        : spin_rounds(spin_rounds < 0 ? 0 : spin_rounds), stop(false), parked(0), overflow_size(0) {
+        if (threads == 0) threads = 1;
+        for (size_t i = 0; i < threads; ++i) workers.emplace_back(new Worker);
+        for (size_t i = 0; i < threads; ++i) {
+            threads_.emplace_back([this, i, on_start] {
+                if (on_start) on_start(i);
+                run(i);
             });
+        }
+    }
+
+    ~ThreadPool() { shutdown(); }
+
+    // 停止线程池：worker 把已经入队的任务全部执行完再退出，返回时所有 worker 都已 join
+    // 任务里引用的对象 (比如连接数组) 要在这之后才能释放；可以重复调用
+    void shutdown() {
+        stop.store(true);
+        for (auto& w : workers) wake(*w);
+        for (std::thread& t : threads_) {
+            if (t.joinable()) t.join();
+        }
     }
 
-    ~ThreadPool() {
-        { std::unique_lock<std::mutex> lock(queue_mutex); stop = true; }
-        condition.notify_all();
-        for(std::thread &worker: workers) worker.join();
+    size_t size() const { return workers.size(); }
+
+    // 当前线程 (某个 loop) 以后提交的任务只在 ids 这几个 worker 之间轮转，比如和它同核 / 共享 L3 的那几个，
+    // 连接的收发和处理就留在同一块缓存上；空闲 worker 偷任务不受影响。ids 为空恢复成在所有 worker 间轮转
+    void set_home(const std::vector<size_t>& ids) {
+        Home& h = tl_home();
+        h.pool = this;
+        h.ids.clear();
+        for (size_t id : ids) {
+            if (id < workers.size()) h.ids.push_back(id);
+        }
     }
 
+    // worker 线程里提交的任务放进自己的队列，其他线程 (各个 loop) 按轮转分给各个 worker
     template<class F>
     void enqueue(F&& f) {
-        { std::unique_lock<std::mutex> lock(queue_mutex); tasks.emplace(std::forward<F>(f)); }
-        condition.notify_one();
+        size_t n = workers.size();
+        int self = self_index();
+        size_t idx;
+        if (self >= 0) {
+            idx = (size_t)self;
+        } else {
+            const Home& h = tl_home();
+            idx = (h.pool == this && !h.ids.empty()) ? h.ids[next_index() % h.ids.size()] : next_index() % n;
+        }
+        Task task(std::forward<F>(f));
+        Worker* w = workers[idx].get();
+        if (!w->tasks.push(std::move(task))) {
+            // 目标队列满了：依次试别的 worker，全满才放进带锁的溢出队列
+            w = nullptr;
+            for (size_t k = 1; k < n && !w; ++k) {
+                Worker* v = workers[(idx + k) % n].get();
+                if (v->tasks.push(std::move(task))) w = v;
+            }
+            if (!w) {
+                std::lock_guard<std::mutex> lock(overflow_mtx);
+                overflow.push_back(std::move(task));
+                overflow_size.fetch_add(1);
+            }
+        }
+        // 和 park() 里的栅栏配对：入队对 worker 可见，或者这里能看到它已经 parked
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // 目标 worker 在睡就叫醒它；它正忙而别的 worker 闲着，叫醒一个来偷
+        if (w && w->parked.load(std::memory_order_relaxed)) wake(*w);
+        else if (parked.load(std::memory_order_relaxed) > 0) wake_one();
     }
 
 private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    std::mutex queue_mutex;
-    std::condition_variable condition;
-    bool stop;
+    struct Worker {
+        Worker() : tasks(QUEUE_SIZE) {}
+
+        MpmcQueue<Task> tasks;           // 自己和窃取者都从头部取，先来先服务
+
+        std::mutex park_mtx;
+        std::condition_variable park_cv;
+        bool wakeup = false;             // 受 park_mtx 保护
+        std::atomic<bool> parked{false};
+    };
+
+    void run(size_t self) {
+        tl_pool() = this;
+        tl_index() = (int)self;
+        Worker& me = *workers[self];
+        Task task;
+        while (true) {
+            if (find(self, task)) {
+                task();
+                task.reset();
+                continue;
+            }
+            // 短暂空转：请求一般一个接一个到来，马上睡眠再被叫醒要多两次 futex
+            bool found = false;
+            for (int i = 0; i < spin_rounds && !found; ++i) {
+                cpu_relax();
+                found = find(self, task);
+            }
+            if (found) {
+                task();
+                task.reset();
+                continue;
+            }
+            if (stop.load() && !any_work()) return;    // 退出前把所有队列取空
+            park(me);
+        }
+    }
+
+    // 先取自己的队列，再从下一个 worker 开始依次偷，最后看溢出队列
+    // worker 按 CPU 拓扑顺序绑核时，编号相邻的 worker 共享缓存，先偷到的是近邻的任务
+    bool find(size_t self, Task& task) {
+        if (workers[self]->tasks.pop(task)) return true;
+        size_t n = workers.size();
+        for (size_t k = 1; k < n; ++k) {
+            if (workers[(self + k) % n]->tasks.pop(task)) return true;
+        }
+        if (overflow_size.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(overflow_mtx);
+            if (!overflow.empty()) {
+                task = std::move(overflow.front());
+                overflow.pop_front();
+                overflow_size.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool any_work() {
+        for (auto& w : workers) {
+            if (!w->tasks.empty()) return true;
+        }
+        return overflow_size.load() > 0;
+    }
+
+    // 先标记 parked 再检查一遍所有队列：提交方入队后检查 parked，两边至少有一方能看到对方
+    void park(Worker& me) {
+        std::unique_lock<std::mutex> lock(me.park_mtx);
+        me.parked.store(true);
+        parked.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!any_work() && !stop.load()) {
+            me.park_cv.wait(lock, [&] { return me.wakeup || stop.load(); });
+        }
+        me.wakeup = false;
+        parked.fetch_sub(1);
+        me.parked.store(false);
+    }
+
+    void wake(Worker& w) {
+        {
+            std::lock_guard<std::mutex> lock(w.park_mtx);
+            w.wakeup = true;
+        }
+        w.park_cv.notify_one();
+    }
+
+    void wake_one() {
+        for (auto& w : workers) {
+            if (w->parked.load()) {
+                wake(*w);
+                return;
+            }
+        }
+    }
+
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    // 当前线程在本池里的 worker 编号，不是本池的 worker 线程返回 -1
+    int self_index() const { return tl_pool() == this ? tl_index() : -1; }
+    static const ThreadPool*& tl_pool() {
+        static thread_local const ThreadPool* pool = nullptr;
+        return pool;
+    }
+    static int& tl_index() {
+        static thread_local int idx = -1;
+        return idx;
+    }
+
+    struct Home {
+        const ThreadPool* pool = nullptr;
+        std::vector<size_t> ids;
+    };
+    static Home& tl_home() {
+        static thread_local Home home;
+        return home;
+    }
+
+    // 提交方各自的轮转计数，不共享原子变量
+    static size_t next_index() {
+        static thread_local size_t rr = std::hash<std::thread::id>()(std::this_thread::get_id());
+        return rr++;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads_;
+    const int spin_rounds;
+    std::atomic<bool> stop;
+    std::atomic<int> parked;             // 正在睡眠的 worker 数
+
+    std::mutex overflow_mtx;             // 所有环形队列都满时的兜底，正常负载下用不到
+    std::deque<Task> overflow;
+    std::atomic<size_t> overflow_size;
 };
-#endif
\ No newline at end of file
+#endif
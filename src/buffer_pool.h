@@ -0,0 +1,165 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <mutex>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+using namespace std;
+
+// 分级 slab 内存池：连接的读写缓冲区按需从这里借，连接空闲时归还
+// 按 2 的幂分级 (1KB ~ 1MB)；小块从 1MB 的 slab 里切，大块单独 malloc，
+// 每级一个空闲链表 + 一把锁，不同大小的申请互不竞争
+// 每个 NUMA 节点一个池：slab 用 mbind 优先放在本节点的内存上，连接固定从所属 loop 节点的池里借还
+class BufferPool {
+public:
+    static const int MIN_SHIFT = 10;   // 最小块 1KB
+    static const int MAX_SHIFT = 20;   // 最大块 1MB
+    static const int SLAB_SHIFT = 20;  // slab 大小 1MB
+    static const int SLAB_MAX_SHIFT = 16;  // <= 64KB 的块从 slab 切分
+    static const int MAX_CACHED_LARGE = 16; // 大块最多缓存的空闲个数，多余的还给系统
+    static const int MAX_NODES = 8;         // 超过的节点号共用最后一个池
+
+    static BufferPool* Instance(int node = 0);
+
+    // 返回容量不小于 size 的块，实际容量写入 cap
+    char* alloc(size_t size, size_t* cap) {
+        int idx = class_index(size);
+        if (idx < 0) return nullptr;
+        *cap = (size_t)1 << (idx + MIN_SHIFT);
+
+        SizeClass& sc = m_classes[idx];
+        {
+            lock_guard<mutex> locker(sc.mtx);
+            if (sc.free_list) {
+                FreeNode* node = sc.free_list;
+                sc.free_list = node->next;
+                --sc.free_count;
+                return (char*)node;
+            }
+            if (idx + MIN_SHIFT <= SLAB_MAX_SHIFT) {
+                refill(sc, *cap);
+                if (!sc.free_list) return nullptr;
+                FreeNode* node = sc.free_list;
+                sc.free_list = node->next;
+                --sc.free_count;
+                return (char*)node;
+            }
+        }
+        return (char*)malloc(*cap);
+    }
+
+    void free(char* p, size_t cap) {
+        if (!p) return;
+        int idx = class_index(cap);
+        if (idx < 0) {
+            // alloc 不会给出这么大的块，只可能是调用方自己 malloc 的：直接还给系统
+            ::free(p);
+            return;
+        }
+        SizeClass& sc = m_classes[idx];
+        {
+            lock_guard<mutex> locker(sc.mtx);
+            bool from_slab = idx + MIN_SHIFT <= SLAB_MAX_SHIFT;
+            if (from_slab || sc.free_count < MAX_CACHED_LARGE) {
+                FreeNode* node = (FreeNode*)p;
+                node->next = sc.free_list;
+                sc.free_list = node;
+                ++sc.free_count;
+                return;
+            }
+        }
+        ::free(p);
+    }
+
+    // 把 [buf, buf+used) 搬到容量不小于 need 的新块里，旧块归还；失败返回 false，原块不变
+    bool grow(char** buf, size_t* cap, size_t used, size_t need) {
+        size_t new_cap = 0;
+        char* new_buf = alloc(need, &new_cap);
+        if (!new_buf) return false;
+        if (*buf) {
+            memcpy(new_buf, *buf, used);
+            free(*buf, *cap);
+        }
+        *buf = new_buf;
+        *cap = new_cap;
+        return true;
+    }
+
+private:
+    struct FreeNode { FreeNode* next; };
+    struct SizeClass {
+        mutex mtx;
+        FreeNode* free_list = nullptr;
+        int free_count = 0;
+    };
+    static const int CLASS_NUM = MAX_SHIFT - MIN_SHIFT + 1;
+    static const size_t SLAB_SIZE = (size_t)1 << SLAB_SHIFT;
+
+    struct Pools;
+
+    BufferPool() : m_node(0) {}
+    ~BufferPool() {
+        for (char* slab : m_slabs) munmap(slab, SLAB_SIZE);
+        for (int i = SLAB_MAX_SHIFT - MIN_SHIFT + 1; i < CLASS_NUM; ++i) {
+            FreeNode* node = m_classes[i].free_list;
+            while (node) {
+                FreeNode* next = node->next;
+                ::free(node);
+                node = next;
+            }
+        }
+    }
+
+    static int class_index(size_t size) {
+        int shift = MIN_SHIFT;
+        while (((size_t)1 << shift) < size) ++shift;
+        return shift > MAX_SHIFT ? -1 : shift - MIN_SHIFT;
+    }
+
+    // 调用者已持有 sc.mtx：申请一个 slab 并切成若干块挂到空闲链表
+    // slab 直接 mmap，在第一次写入 (切块) 之前设好内存策略；mbind 失败 (没有这个节点) 时按首次访问分配
+    void refill(SizeClass& sc, size_t chunk) {
+        void* mem = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return;
+        char* slab = (char*)mem;
+        unsigned long mask = 1UL << m_node;
+        syscall(SYS_mbind, slab, SLAB_SIZE, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+        {
+            lock_guard<mutex> locker(m_slab_mtx);
+            m_slabs.push_back(slab);
+        }
+        size_t n = SLAB_SIZE / chunk;
+        for (size_t i = 0; i < n; ++i) {
+            FreeNode* node = (FreeNode*)(slab + i * chunk);
+            node->next = sc.free_list;
+            sc.free_list = node;
+        }
+        sc.free_count += n;
+    }
+
+    int m_node;
+    SizeClass m_classes[CLASS_NUM];
+    mutex m_slab_mtx;
+    vector<char*> m_slabs;
+};
+
+struct BufferPool::Pools {
+    BufferPool pool[MAX_NODES];
+    Pools() {
+        for (int i = 0; i < MAX_NODES; ++i) pool[i].m_node = i;
+    }
+};
+
+inline BufferPool* BufferPool::Instance(int node) {
+    static Pools pools;
+    if (node < 0) node = 0;
+    return &pools.pool[node < MAX_NODES ? node : MAX_NODES - 1];
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// CPU 拓扑：从 /sys/devices/system/cpu 读出本进程可用的每个 CPU 属于哪个 NUMA 节点、
+// 哪组共享 L3 的核 (cache 域)、哪个物理核，按 (节点, cache 域, 超线程序号, 物理核) 排好序；
+// 排序后相邻的 CPU 共享的缓存最多，按下标顺序分配线程就能让相关的线程挨在一起
+// 读不到 sysfs (容器裁剪过) 时退化为所有 CPU 在同一个节点、同一个 cache 域
+class CpuTopology {
+public:
+    struct Cpu {
+        int id;
+        int node;       // NUMA 节点
+        int llc;        // 共享 L3 的 CPU 组，用组里编号最小的 CPU 表示
+        int core;       // 物理核 (同一个核上的超线程共享 L1/L2)
+        int smt;        // 是这个物理核上的第几个超线程
+    };
+
+    static CpuTopology* Instance() {
+        static CpuTopology topo;
+        return &topo;
+    }
+
+    const vector<Cpu>& cpus() const { return m_cpus; }
+    int node_count() const { return m_nodes; }
+
+    // 第 i 个线程该用的 CPU (按排好的顺序轮转)
+    const Cpu& cpu_for(size_t i) const { return m_cpus[i % m_cpus.size()]; }
+
+    // 把当前线程绑到 cpu 上，并记下它所在的 NUMA 节点 (current_node() 用)
+    bool pin(const Cpu& cpu) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu.id, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) return false;
+        tl_node() = cpu.node;
+        return true;
+    }
+
+    // 当前线程绑定的 NUMA 节点，没绑过的线程为 0
+    static int current_node() { return tl_node(); }
+
+private:
+    CpuTopology() : m_nodes(1) {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            for (int i = 0; i < CPU_SETSIZE; ++i) CPU_SET(i, &allowed);
+        }
+        int online[CPU_SETSIZE] = {0};
+        if (!read_list("/sys/devices/system/cpu/online", online)) {
+            online[0] = 1;
+        }
+        for (int id = 0; id < CPU_SETSIZE; ++id) {
+            if (!online[id] || !CPU_ISSET(id, &allowed)) continue;
+            Cpu c;
+            c.id = id;
+            c.node = cpu_node(id);
+            c.llc = cpu_llc(id);
+            c.core = read_int(id, "topology/physical_package_id", 0) * 4096 + read_int(id, "topology/core_id", id);
+            c.smt = 0;
+            for (const Cpu& prev : m_cpus) {
+                if (prev.core == c.core) ++c.smt;
+            }
+            m_cpus.push_back(c);
+            m_nodes = max(m_nodes, c.node + 1);
+        }
+        if (m_cpus.empty()) m_cpus.push_back(Cpu{0, 0, 0, 0, 0});
+        // 同一个 cache 域里先排每个物理核的第一个超线程，再排第二个：
+        // 线程数不超过物理核数时不会有两个线程挤在同一个核上
+        sort(m_cpus.begin(), m_cpus.end(), [](const Cpu& a, const Cpu& b) {
+            if (a.node != b.node) return a.node < b.node;
+            if (a.llc != b.llc) return a.llc < b.llc;
+            if (a.smt != b.smt) return a.smt < b.smt;
+            return a.core < b.core;
+        });
+    }
+
+    static int& tl_node() {
+        static thread_local int node = 0;
+        return node;
+    }
+
+    // 解析 "0-3,8,10-11" 这样的 CPU 列表
+    static bool read_list(const char* path, int* out) {
+        char buf[4096];
+        if (!read_file(path, buf, sizeof(buf))) return false;
+        const char* p = buf;
+        while (*p >= '0' && *p <= '9') {
+            char* end;
+            long lo = strtol(p, &end, 10), hi = lo;
+            if (*end == '-') hi = strtol(end + 1, &end, 10);
+            for (long i = lo; i <= hi && i < CPU_SETSIZE; ++i) out[i] = 1;
+            p = *end == ',' ? end + 1 : end;
+        }
+        return true;
+    }
+
+    static bool read_file(const char* path, char* buf, size_t len) {
+        FILE* f = fopen(path, "r");
+        if (!f) return false;
+        size_t n = fread(buf, 1, len - 1, f);
+        fclose(f);
+        buf[n] = '\0';
+        return n > 0;
+    }
+
+    static int read_int(int cpu, const char* name, int def) {
+        char path[128], buf[32];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, name);
+        if (!read_file(path, buf, sizeof(buf))) return def;
+        return atoi(buf);
+    }
+
+    // cpuN 目录下有一个 nodeM 链接
+    static int cpu_node(int cpu) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+        DIR* dir = opendir(path);
+        if (!dir) return 0;
+        int node = 0;
+        while (struct dirent* ent = readdir(dir)) {
+            if (strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
+                node = atoi(ent->d_name + 4);
+                break;
+            }
+        }
+        closedir(dir);
+        return node;
+    }
+
+    // 最后一级缓存 (index 最大的那一级) 的共享 CPU 列表里编号最小的 CPU
+    static int cpu_llc(int cpu) {
+        for (int idx = 3; idx >= 0; --idx) {
+            char path[128];
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, idx);
+            int shared[CPU_SETSIZE] = {0};
+            if (!read_list(path, shared)) continue;
+            for (int i = 0; i < CPU_SETSIZE; ++i) {
+                if (shared[i]) return i;
+            }
+        }
+        return 0;
+    }
+
+    vector<Cpu> m_cpus;
+    int m_nodes;
+};
+
+#endif
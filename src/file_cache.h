@@ -0,0 +1,378 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <shared_mutex>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#include "http_response.h"
+
+using namespace std;
+
+// 静态文件缓存：按 URL 缓存已打开的文件 (小文件直接读进内存)、大小、MIME 和拼好的响应头
+// 命中时不碰文件系统 (没有 stat/open/close)；后台线程用 inotify 监听资源目录，文件变动即失效
+// 未调用 init() (或 inotify 不可用) 时不缓存，每次都从磁盘加载，保证不会返回过期内容
+// 文本类文件首次加载时顺带压缩出 gzip / brotli 版本，按请求的 Accept-Encoding 选用，不再逐请求压缩
+class FileCache {
+public:
+    static const int MAX_ENTRIES = 256;                  // 最多缓存的文件数
+    static const size_t SMALL_FILE = 64 * 1024;          // 不超过此大小的文件整体读进内存
+    static const size_t MAX_MEM_BYTES = 64 * 1024 * 1024; // 内存中文件内容的总上限
+    static const size_t MIN_COMPRESS = 256;              // 太小的文件压缩不划算
+    static const size_t MAX_COMPRESS = 4 * 1024 * 1024;  // 超过此大小的文件不预压缩
+
+    // 内容编码，ENC_IDENTITY 为原始内容；请求可接受的编码用 (1 << ENC_xxx) 位掩码表示
+    enum ENCODING { ENC_IDENTITY = 0, ENC_GZIP, ENC_BR, ENC_NUM };
+
+    struct Entry {
+        string url;          // 缓存键，m_map 的键指向这里
+        int fd;              // 大文件：缓存持有的只读 fd (sendfile 带 offset 发送，不改变文件位置，可多连接共用)
+        size_t size;         // 原始文件的响应体长度
+        string body[ENC_NUM];        // [ENC_IDENTITY] 小文件内容；其余为压缩版本，空串表示没有该版本
+        string header[ENC_NUM];      // 预先拼好的 200 响应头 (不含 Date / Connection 和结尾空行，由连接按请求补上)
+        const HttpMime* mime;
+        bool vary;                   // 有压缩版本，响应需要带 Vary: Accept-Encoding
+        time_t mtime;
+        char last_modified[32];      // HTTP-date 格式的修改时间，用于 If-Modified-Since / If-Range
+        char etag[ENC_NUM][64];      // 每种编码各自的强校验值 (由 mtime + size 生成，压缩版本带后缀)
+        mutable atomic<uint64_t> last_use;
+
+        Entry() : fd(-1), size(0), mime(nullptr), vary(false), mtime(0), last_use(0) {
+            last_modified[0] = '\0';
+            for (int i = 0; i < ENC_NUM; ++i) etag[i][0] = '\0';
+        }
+        ~Entry() { if (fd >= 0) close(fd); }
+
+        // 在客户端可接受的编码里挑最小的版本 (br 优先于 gzip)
+        ENCODING pick(unsigned accept) const {
+            if ((accept & (1u << ENC_BR)) && !body[ENC_BR].empty()) return ENC_BR;
+            if ((accept & (1u << ENC_GZIP)) && !body[ENC_GZIP].empty()) return ENC_GZIP;
+            return ENC_IDENTITY;
+        }
+        size_t mem_bytes() const {
+            size_t n = 0;
+            for (int i = 0; i < ENC_NUM; ++i) n += body[i].size();
+            return n;
+        }
+    };
+    typedef shared_ptr<const Entry> EntryPtr;
+
+    static FileCache* Instance() {
+        static FileCache cache;
+        return &cache;
+    }
+
+    // 监听 root 下的所有目录并启用缓存；失败时缓存保持关闭
+    bool init(const char* root) {
+        m_root = root;
+        m_inotify_fd = inotify_init1(IN_CLOEXEC);
+        if (m_inotify_fd < 0) return false;
+        if (!add_watch(m_root, "")) {
+            close(m_inotify_fd);
+            m_inotify_fd = -1;
+            return false;
+        }
+        m_enabled = true;
+        thread(&FileCache::watch_loop, this).detach();
+        return true;
+    }
+
+    // 查找 root + url 对应的文件；err 返回 0 / ENOENT / EACCES / EISDIR
+    EntryPtr get(const char* root, const char* url, int* err) {
+        uint64_t tick = ++m_tick;
+        if (m_enabled) {
+            shared_lock<shared_timed_mutex> locker(m_mtx);
+            auto it = m_map.find(UrlKey(url, strlen(url)));
+            if (it != m_map.end()) {
+                it->second->last_use.store(tick, memory_order_relaxed);
+                *err = 0;
+                return it->second;
+            }
+        }
+
+        // 未命中：记下当前代数，加载期间若有失效事件就不插入，避免缓存刚被改掉的旧内容
+        uint64_t gen = m_gen.load(memory_order_acquire);
+        shared_ptr<Entry> e = load(root, url, err);
+        if (!e || !m_enabled) return e;
+        e->last_use.store(tick, memory_order_relaxed);
+
+        unique_lock<shared_timed_mutex> locker(m_mtx);
+        if (gen != m_gen.load(memory_order_acquire)) return e;
+        auto it = m_map.find(UrlKey(url, strlen(url)));
+        if (it != m_map.end()) return it->second;
+        while (!m_map.empty() && ((int)m_map.size() >= MAX_ENTRIES
+                                  || m_mem_bytes + e->mem_bytes() > MAX_MEM_BYTES)) {
+            evict_one();
+        }
+        m_mem_bytes += e->mem_bytes();
+        e->url = url;
+        m_map.emplace(UrlKey(e->url.data(), e->url.size()), e);
+        return e;
+    }
+
+    // url 已经在缓存里且内容整个读进了内存 (小文件)：处理它不会碰磁盘，loop 线程据此决定能否就地处理
+    // url 不需要以 '\0' 结尾，可以直接指向读缓冲区，查找不分配内存
+    bool resident(const char* url, size_t len) {
+        if (!m_enabled) return false;
+        shared_lock<shared_timed_mutex> locker(m_mtx);
+        auto it = m_map.find(UrlKey(url, len));
+        return it != m_map.end() && it->second->fd < 0;
+    }
+
+private:
+    // 不持有内存的 URL 键：表里的键指向条目自己的 url，查找时直接指向调用方的字符串，不构造 std::string
+    struct UrlKey {
+        const char* data;
+        size_t len;
+        UrlKey(const char* d, size_t n) : data(d), len(n) {}
+        bool operator==(const UrlKey& o) const { return len == o.len && memcmp(data, o.data, len) == 0; }
+    };
+    struct UrlHash {
+        size_t operator()(const UrlKey& k) const {
+            uint64_t h = 14695981039346656037ULL;   // FNV-1a
+            for (size_t i = 0; i < k.len; ++i) h = (h ^ (unsigned char)k.data[i]) * 1099511628211ULL;
+            return (size_t)h;
+        }
+    };
+
+    FileCache() : m_inotify_fd(-1), m_enabled(false), m_tick(0), m_gen(0), m_mem_bytes(0) {}
+
+    shared_ptr<Entry> load(const char* root, const char* url, int* err) {
+        char real_file[256];
+        snprintf(real_file, sizeof(real_file), "%s%s", root, url);
+
+        struct stat st;
+        if (stat(real_file, &st) < 0) { *err = ENOENT; return nullptr; }
+        if (!(st.st_mode & S_IROTH)) { *err = EACCES; return nullptr; }
+        if (S_ISDIR(st.st_mode)) { *err = EISDIR; return nullptr; }
+        int fd = open(real_file, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { *err = ENOENT; return nullptr; }
+
+        shared_ptr<Entry> e = make_shared<Entry>();
+        const HttpMime* mime = http_mime(url);
+        bool compress = strncmp(mime->type, "text/", 5) == 0 && (size_t)st.st_size >= MIN_COMPRESS
+                        && (size_t)st.st_size <= MAX_COMPRESS;
+        string& raw = e->body[ENC_IDENTITY];
+        string big;  // 大文件只为压缩临时读入，发送原始版本仍然走 sendfile
+        if (st.st_size == 0) {
+            // 空文件沿用原来的行为：回一个空页面
+            raw = "<html><body></body></html>";
+            close(fd);
+        } else if ((size_t)st.st_size <= SMALL_FILE) {
+            raw.resize(st.st_size);
+            ssize_t n = pread(fd, &raw[0], st.st_size, 0);
+            close(fd);
+            if (n != st.st_size) { *err = ENOENT; return nullptr; }
+        } else {
+            e->fd = fd;
+            if (compress) {
+                big.resize(st.st_size);
+                if (pread(fd, &big[0], st.st_size, 0) != st.st_size) compress = false;
+            }
+        }
+        e->size = e->fd >= 0 ? (size_t)st.st_size : raw.size();
+
+        if (compress) {
+            const string& src = e->fd >= 0 ? big : raw;
+#ifdef HAVE_ZLIB
+            e->body[ENC_GZIP] = gzip(src);
+#endif
+#ifdef HAVE_BROTLI
+            e->body[ENC_BR] = brotli(src);
+#endif
+            // 压缩收益不到 10% 的版本不值得保留
+            for (int i = ENC_GZIP; i < ENC_NUM; ++i) {
+                if (e->body[i].size() >= src.size() / 10 * 9) e->body[i].clear();
+            }
+        }
+        e->mime = mime;
+        e->vary = !e->body[ENC_GZIP].empty() || !e->body[ENC_BR].empty();
+        e->mtime = st.st_mtime;
+        struct tm tm;
+        gmtime_r(&st.st_mtime, &tm);
+        strftime(e->last_modified, sizeof(e->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+        static const char* const enc_names[ENC_NUM] = { nullptr, "gzip", "br" };
+        for (int enc = 0; enc < ENC_NUM; ++enc) {
+            snprintf(e->etag[enc], sizeof(e->etag[enc]), "\"%llx.%lx-%llx%s%s\"",
+                     (unsigned long long)st.st_mtim.tv_sec, (unsigned long)st.st_mtim.tv_nsec,
+                     (unsigned long long)st.st_size, enc_names[enc] ? "-" : "", enc_names[enc] ? enc_names[enc] : "");
+        }
+
+        for (int enc = 0; enc < ENC_NUM; ++enc) {
+            if (enc != ENC_IDENTITY && e->body[enc].empty()) continue;
+            size_t len = enc == ENC_IDENTITY ? e->size : e->body[enc].size();
+            char buf[512];
+            // Range 只对原始内容生效，压缩版本不声明 Accept-Ranges
+            int n = snprintf(buf, sizeof(buf),
+                             "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n%s%s%s%s"
+                             "ETag: %s\r\nLast-Modified: %s\r\n%s%s",
+                             len, mime->header.str,
+                             enc_names[enc] ? "Content-Encoding: " : "", enc_names[enc] ? enc_names[enc] : "",
+                             enc_names[enc] ? "\r\n" : "", e->etag[enc], e->last_modified,
+                             enc == ENC_IDENTITY ? "Accept-Ranges: bytes\r\n" : "",
+                             e->vary ? "Vary: Accept-Encoding\r\n" : "");
+            e->header[enc].assign(buf, n);
+        }
+        *err = 0;
+        return e;
+    }
+
+#ifdef HAVE_ZLIB
+    static string gzip(const string& src) {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        // windowBits 15 + 16：输出带 gzip 头尾，而不是裸 zlib 流
+        if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) return string();
+        string out;
+        out.resize(deflateBound(&zs, src.size()) + 32);
+        zs.next_in = (Bytef*)src.data();
+        zs.avail_in = src.size();
+        zs.next_out = (Bytef*)&out[0];
+        zs.avail_out = out.size();
+        int ret = deflate(&zs, Z_FINISH);
+        out.resize(ret == Z_STREAM_END ? zs.total_out : 0);
+        deflateEnd(&zs);
+        return out;
+    }
+#endif
+
+#ifdef HAVE_BROTLI
+    static string brotli(const string& src) {
+        string out;
+        size_t len = BrotliEncoderMaxCompressedSize(src.size());
+        if (len == 0) return out;
+        out.resize(len);
+        // 只在首次加载时压缩一次，用较高的压缩等级换更小的传输量
+        if (!BrotliEncoderCompress(9, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, src.size(),
+                                   (const uint8_t*)src.data(), &len, (uint8_t*)&out[0])) {
+            len = 0;
+        }
+        out.resize(len);
+        return out;
+    }
+#endif
+
+    // 调用者已持有写锁：淘汰最久未使用的一项 (条目数有上限，线性扫描即可)
+    void evict_one() {
+        auto victim = m_map.begin();
+        for (auto it = m_map.begin(); it != m_map.end(); ++it) {
+            if (it->second->last_use.load(memory_order_relaxed) <
+                victim->second->last_use.load(memory_order_relaxed)) {
+                victim = it;
+            }
+        }
+        m_mem_bytes -= victim->second->mem_bytes();
+        m_map.erase(victim);
+    }
+
+    void invalidate(const string& url) {
+        unique_lock<shared_timed_mutex> locker(m_mtx);
+        m_gen.fetch_add(1, memory_order_release);
+        auto it = m_map.find(UrlKey(url.data(), url.size()));
+        if (it == m_map.end()) return;
+        m_mem_bytes -= it->second->mem_bytes();
+        m_map.erase(it); // 正在发送该文件的连接仍持有 shared_ptr，发完才真正 close
+    }
+
+    void invalidate_all() {
+        unique_lock<shared_timed_mutex> locker(m_mtx);
+        m_gen.fetch_add(1, memory_order_release);
+        m_map.clear();
+        m_mem_bytes = 0;
+    }
+
+    // 递归监听目录，wd -> URL 前缀 (比如 "" 或 "/img")
+    bool add_watch(const string& dir, const string& prefix) {
+        int wd = inotify_add_watch(m_inotify_fd, dir.c_str(),
+                                   IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                   IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+        if (wd < 0) return false;
+        {
+            unique_lock<shared_timed_mutex> locker(m_mtx);
+            m_watches[wd] = prefix;
+        }
+        DIR* d = opendir(dir.c_str());
+        if (!d) return true;
+        while (struct dirent* ent = readdir(d)) {
+            if (ent->d_type != DT_DIR || strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+            add_watch(dir + "/" + ent->d_name, prefix + "/" + ent->d_name);
+        }
+        closedir(d);
+        return true;
+    }
+
+    void watch_loop() {
+        alignas(struct inotify_event) char buf[4096];
+        for (;;) {
+            ssize_t n = read(m_inotify_fd, buf, sizeof(buf));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                break;
+            }
+            for (char* p = buf; p < buf + n; ) {
+                struct inotify_event* ev = (struct inotify_event*)p;
+                p += sizeof(struct inotify_event) + ev->len;
+                handle_event(ev);
+            }
+        }
+        // 监听失效：关闭缓存，之后每次都从磁盘加载
+        m_enabled = false;
+        invalidate_all();
+    }
+
+    void handle_event(const struct inotify_event* ev) {
+        if (ev->mask & IN_Q_OVERFLOW) { invalidate_all(); return; }
+
+        string prefix;
+        {
+            shared_lock<shared_timed_mutex> locker(m_mtx);
+            auto it = m_watches.find(ev->wd);
+            if (it == m_watches.end()) return;
+            prefix = it->second;
+        }
+        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+            // 整个目录没了：清空缓存比逐个找该目录下的条目简单
+            invalidate_all();
+            return;
+        }
+        if (ev->len == 0) return;
+        string url = prefix + "/" + ev->name;
+        invalidate(url);
+        if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) && (ev->mask & IN_ISDIR)) {
+            add_watch(m_root + url, url);
+        }
+    }
+
+    string m_root;                // 被监听的资源根目录
+    int m_inotify_fd;
+    atomic<bool> m_enabled;
+    atomic<uint64_t> m_tick;      // 访问计数，用作近似 LRU 的时间戳
+    atomic<uint64_t> m_gen;       // 失效代数，防止并发加载把旧内容插回缓存
+    size_t m_mem_bytes;           // 受 m_mtx 保护
+
+    shared_timed_mutex m_mtx;
+    unordered_map<UrlKey, shared_ptr<const Entry>, UrlHash> m_map;
+    unordered_map<int, string> m_watches;
+};
+
+#endif
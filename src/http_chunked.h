@@ -0,0 +1,117 @@
+#ifndef HTTP_CHUNKED_H
+#define HTTP_CHUNKED_H
+
+#include <string.h>
+
+// Transfer-Encoding: chunked 请求体的就地解码器
+// 请求体区 buf[0, len)：前 body() 字节是已经解出来的数据，[raw(), len) 是还没解码的原始字节
+// 解码只会把数据往前挪 (body() <= raw() 恒成立)，不需要额外缓冲区；位置都是相对请求体开头的偏移，
+// 读缓冲区扩容搬家也不受影响
+class ChunkedDecoder {
+public:
+    static const int MAX_LINE = 1024;   // 块大小行 (含 chunk-ext) 和 trailer 行的长度上限
+
+    enum STATUS {
+        NEED_MORE = 0,  // 还没收到最后一块
+        DONE,           // 最后一块和 trailer 都收齐了，raw() 是请求体 (含分块格式) 之后的第一个字节
+        BAD             // 格式错误
+    };
+
+    ChunkedDecoder() { reset(); }
+
+    void reset() {
+        m_state = SIZE;
+        m_left = 0;
+        m_body = 0;
+        m_raw = 0;
+    }
+
+    int body() const { return m_body; }
+    int raw() const { return m_raw; }
+
+    // 调用者把前 n 个已解码字节处理掉并从缓冲区移走以后调用 (multipart 边收边写盘)
+    void consume(int n) {
+        m_body -= n;
+        m_raw -= n;
+    }
+
+    STATUS decode(char* buf, int len) {
+        while (true) {
+            switch (m_state) {
+                case SIZE: {
+                    // 十六进制块大小，后面可以跟 ";ext"，以 \r\n 结尾
+                    const char* line = buf + m_raw;
+                    const char* eol = find_crlf(line, buf + len);
+                    if (!eol) return len - m_raw > MAX_LINE ? BAD : NEED_MORE;
+                    long long size = 0;
+                    const char* p = line;
+                    for (; p < eol; ++p) {
+                        int d = hex(*p);
+                        if (d < 0) break;
+                        if (size > (1LL << 56)) return BAD;
+                        size = size * 16 + d;
+                    }
+                    if (p == line || (p < eol && *p != ';' && *p != ' ' && *p != '\t')) return BAD;
+                    m_raw = eol + 2 - buf;
+                    m_left = size;
+                    m_state = size ? DATA : TRAILER;
+                    break;
+                }
+                case DATA: {
+                    long long n = len - m_raw;
+                    if (n > m_left) n = m_left;
+                    if (n == 0) return NEED_MORE;
+                    if (m_body != m_raw) memmove(buf + m_body, buf + m_raw, n);
+                    m_body += n;
+                    m_raw += n;
+                    m_left -= n;
+                    if (m_left == 0) m_state = DATA_CRLF;
+                    break;
+                }
+                case DATA_CRLF:
+                    if (len - m_raw < 2) return NEED_MORE;
+                    if (buf[m_raw] != '\r' || buf[m_raw + 1] != '\n') return BAD;
+                    m_raw += 2;
+                    m_state = SIZE;
+                    break;
+                case TRAILER: {
+                    // trailer 字段直接跳过，空行表示结束
+                    const char* line = buf + m_raw;
+                    const char* eol = find_crlf(line, buf + len);
+                    if (!eol) return len - m_raw > MAX_LINE ? BAD : NEED_MORE;
+                    m_raw = eol + 2 - buf;
+                    if (eol == line) m_state = FINISHED;
+                    break;
+                }
+                case FINISHED:
+                    return DONE;
+            }
+        }
+    }
+
+private:
+    enum STATE { SIZE = 0, DATA, DATA_CRLF, TRAILER, FINISHED };
+
+    static int hex(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    static const char* find_crlf(const char* p, const char* end) {
+        for (; end - p >= 2; ++p) {
+            p = (const char*)memchr(p, '\r', end - p - 1);
+            if (!p) return nullptr;
+            if (p[1] == '\n') return p;
+        }
+        return nullptr;
+    }
+
+    STATE m_state;
+    long long m_left;   // 当前块还没收到的数据字节
+    int m_body;         // 已解码数据的长度
+    int m_raw;          // 第一个还没解码的原始字节
+};
+
+#endif
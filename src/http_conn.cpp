@@ -1,31 +1,54 @@
 #include "http_conn.h"
 #include "sql_conn_pool.h"
 #include <sys/epoll.h>
-#include <stdarg.h>
 #include <map>
 #include <iostream>
+#include <algorithm>
 #include "log.h" 
+#include "cpu_topology.h"
 
 using namespace std;
 
 const char* doc_root = "resources";
 
-int HttpConn::m_epollfd = -1;
-int HttpConn::m_user_count = 0;
+atomic<int> HttpConn::m_user_count(0);
+HttpConn::RearmHook HttpConn::s_rearm_hook = nullptr;
+HttpConn::Timeouts HttpConn::s_timeouts = { HEADER_TIMEOUT, BODY_TIMEOUT, IDLE_TIMEOUT, WRITE_TIMEOUT,
+                                            MIN_RATE, MIN_RATE };
+const size_t HttpConn::SENDFILE_CHUNK;      // 传给 min() 按引用取址，C++14 下需要类外定义
 
 map<string, string> users;
 mutex m_lock;
 
-const char* get_mime_type(const char* name) {
-    if (strstr(name, ".html")) return "text/html";
-    else if (strstr(name, ".css")) return "text/css";
-    else if (strstr(name, ".js")) return "text/javascript";
-    else if (strstr(name, ".png")) return "image/png";
-    else if (strstr(name, ".jpg") || strstr(name, ".jpeg")) return "image/jpeg";
-    else if (strstr(name, ".gif")) return "image/gif";
-    else if (strstr(name, ".mp4")) return "video/mp4";  
-    else if (strstr(name, ".avi")) return "video/x-msvideo";
-    else return "text/plain";
+// 解析 Accept-Encoding (比如 "gzip, deflate, br;q=0.9")，返回可接受编码的位掩码
+// q=0 表示明确拒绝；"*" 表示其他未列出的编码都可以
+static unsigned parse_accept_encoding(const char* text) {
+    unsigned accept = 0, reject = 0;
+    bool any = false;
+    while (*text) {
+        text += strspn(text, " \t,");
+        size_t len = strcspn(text, " \t,;");
+        if (len == 0) break;
+        const char* token = text;
+        text += len;
+        // 参数部分：只关心 q 值是否为 0
+        bool zero = false;
+        const char* end = text + strcspn(text, ",");
+        const char* q = strstr(text, "q=");
+        if (q && q < end) {
+            q += 2;
+            zero = atof(q) <= 0.0;
+        }
+        unsigned bit = 0;
+        if (len == 4 && strncasecmp(token, "gzip", 4) == 0) bit = 1u << FileCache::ENC_GZIP;
+        else if (len == 2 && strncasecmp(token, "br", 2) == 0) bit = 1u << FileCache::ENC_BR;
+        else if (len == 1 && token[0] == '*') any = !zero;
+        if (zero) reject |= bit;
+        else accept |= bit;
+        text = end;
+    }
+    if (any) accept |= ~reject & ((1u << FileCache::ENC_GZIP) | (1u << FileCache::ENC_BR));
+    return accept & ~reject;
 }
 
 void setnonblocking(int fd) {
@@ -34,13 +57,13 @@ void setnonblocking(int fd) {
     fcntl(fd, F_SETFL, new_option);
 }
 
-void addfd(int epollfd, int fd, bool one_shot) {
+void addfd(int epollfd, int fd, bool one_shot, bool set_nonblock) {
     epoll_event event;
     event.data.fd = fd;
     event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
     if(one_shot) event.events |= EPOLLONESHOT;
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    setnonblocking(fd);
+    if(set_nonblock) setnonblocking(fd);
 }
 
 void removefd(int epollfd, int fd) {
@@ -75,44 +98,67 @@ void HttpConn::initmysql_result(SqlConnPool* connPool) {
     }
 }
 
-void HttpConn::init(int sockfd, const sockaddr_in& addr) {
+void HttpConn::init(int sockfd, const sockaddr_in& addr, int epollfd, void* loop) {
     m_sockfd = sockfd;
+    m_epollfd = epollfd;
+    m_loop = loop;
+    m_node = CpuTopology::current_node();   // init 在所属 loop 线程里调用
     m_address = addr;
-    int reuse = 1;
-    setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-    addfd(m_epollfd, sockfd, true); 
+    // accept4 已经带上 SOCK_NONBLOCK，这里省掉两次 fcntl
+    // io_uring 后端不经过 epoll，由所属 loop 自己提交 recv
+    if (m_epollfd >= 0) addfd(m_epollfd, sockfd, true, false); 
     m_user_count++;
+    m_phase_start = -1;
+    m_bytes_received = 0;
+    m_bytes_sent = 0;
     init_parse_state();
 }
 
+// 连接级重置：丢掉缓冲区里的所有数据和待发送的响应 (新连接 / 关闭连接)
 void HttpConn::init_parse_state() {
+    m_read_idx = 0;
+    m_write_idx = 0;
+    m_keep_alive = false;
+    m_pipeline_pending = false;
+    clear_send_queue();
+    reset_request();
+
+    // 连接进入空闲：缓冲区还给内存池，空闲长连接只剩对象本身
+    release_buffers();
+}
+
+// 请求级重置：只清解析状态，读缓冲区里后续 (流水线) 请求的字节和已排队的响应都保留
+void HttpConn::reset_request() {
     m_check_state = CHECK_STATE_REQUESTLINE;
     m_method = GET;
-    m_read_idx = 0;
     m_checked_idx = 0;
     m_start_line = 0;
-    m_write_idx = 0;
     m_content_length = 0;
+    m_colon = -1;
+    m_line_end = 0;
     
     m_url = 0;
     m_version = 0;
     m_host = 0;
     m_string = nullptr;
-    m_file_address = 0;
     m_linger = false;
+    // 响应还在队列里时，它引用的缓存条目要一直持有到发送完毕
+    if (m_file) m_files.push_back(std::move(m_file));
     
-    memset(m_read_buf, 0, sizeof(m_read_buf));
-    memset(m_write_buf, 0, sizeof(m_write_buf));
-
     // 【新增】在这里初始化 Cookie 状态 (每次请求开始前重置)
     // =======================================================
     m_set_cookie = 0;         // 默认不发 Set-Cookie
     m_cookie_is_login = false;// 默认没有登录
+    m_accept_enc = 0;         // 没带 Accept-Encoding 时只发原始内容
+    m_range = nullptr;
+    m_if_range = nullptr;
+    m_if_none_match = nullptr;
+    m_if_modified_since = nullptr;
 
     // 【新增】文件上传变量初始化
-    memset(m_boundary, 0, sizeof(m_boundary));
     m_is_multipart = false;
-    memset(m_upload_filename, 0, sizeof(m_upload_filename));
+    m_chunked = false;
+    m_chunk.reset();
     m_file_content = nullptr;
 
     // 【新增】在这里初始化 JSON 状态
@@ -120,55 +166,154 @@ void HttpConn::init_parse_state() {
     m_json_string = nullptr;
 }
 
-void HttpConn::close_conn() {
+// 一个请求的响应已经排进发送队列：把它之后的字节 (流水线里的下一个请求) 挪到缓冲区开头
+// 返回缓冲区里是否还有剩余字节
+bool HttpConn::next_request() {
+    int end = m_checked_idx;
+    if (m_check_state == CHECK_STATE_CONTENT) {
+        if (m_chunked) {
+            // 解码后的数据连同分块格式一起跳过 (补的 '\0' 落在分块格式里，不用还原)
+            end += m_chunk.raw();
+        } else if (!m_is_multipart) {
+            // multipart 的请求体在解析时已经从缓冲区挪走了
+            end += m_content_length;
+            // parse_content 为了补 '\0' 覆盖了下一个请求的第一个字节，这里还原
+            if (end < m_read_idx) m_read_buf[end] = m_end_byte;
+        }
+    }
+    int left = m_read_idx - end;
+    if (left > 0) memmove(m_read_buf, m_read_buf + end, left);
+    m_read_idx = left > 0 ? left : 0;
+    reset_request();
+    return m_read_idx > 0;
+}
+
+void HttpConn::release_buffers() {
+    buffers()->free(m_read_buf, m_read_cap);
+    m_read_buf = nullptr;
+    m_read_cap = 0;
+    buffers()->free(m_write_buf, m_write_cap);
+    m_write_buf = nullptr;
+    m_write_cap = 0;
+    delete m_upload;
+    m_upload = nullptr;
+}
+
+// 保证读缓冲区还有空位 (末尾预留 1 字节给 parse_content 写 '\0')：
+// 第一次读时借 4KB，写满了按 2 倍扩容，超过 READ_BUFFER_SIZE 视为请求过大
+bool HttpConn::ensure_read_space() {
+    if (m_read_buf && m_read_idx + 1 < (int)m_read_cap) return true;
+    size_t need = m_read_buf ? m_read_cap * 2 : READ_BUFFER_INIT;
+    if (need > READ_BUFFER_SIZE) return false;
+    char* old_buf = m_read_buf;
+    if (!buffers()->grow(&m_read_buf, &m_read_cap, m_read_idx, need)) return false;
+    if (old_buf) rebase_read_ptrs(old_buf);
+    return true;
+}
+
+// 读缓冲区搬家后，把已经解析出来、指向旧缓冲区的指针平移到新缓冲区
+void HttpConn::rebase_read_ptrs(char* old_buf) {
+    char** ptrs[] = { &m_url, &m_version, &m_host, &m_string, &m_file_content, &m_range, &m_if_range,
+                      &m_if_none_match, &m_if_modified_since };
+    for (char** p : ptrs) {
+        if (*p && *p >= old_buf && *p < old_buf + m_read_cap) {
+            *p = m_read_buf + (*p - old_buf);
+        }
+    }
+}
+
+bool HttpConn::ensure_write_buf() {
+    if (m_write_buf) return true;
+    return buffers()->grow(&m_write_buf, &m_write_cap, 0, WRITE_BUFFER_SIZE);
+}
+
+void HttpConn::close_conn(bool real_close) {
     if(m_sockfd != -1) {
-        removefd(m_epollfd, m_sockfd);
+        // real_close == false：只回收连接状态，fd 由调用者 (io_uring loop) 异步关闭
+        if (real_close) {
+            if (m_epollfd < 0) {
+                // ring 里可能还挂着该 fd 的 recv，先 shutdown 让它完成，否则 close 后连接并不会真正断开
+                shutdown(m_sockfd, SHUT_RDWR);
+                close(m_sockfd);
+            } else {
+                removefd(m_epollfd, m_sockfd);
+            }
+        }
         m_sockfd = -1;
         m_user_count--;
+        clear_send_queue();
+        release_buffers();
     }
 }
 
+// worker 处理完把连接交还给所属 loop：loop 挂回交出时摘下的定时器，再 EPOLL_CTL_MOD 或提交 SQE
+// 没有所属 loop 时直接 EPOLL_CTL_MOD
+void HttpConn::rearm(int ev) {
+    if (m_loop) s_rearm_hook(m_loop, m_sockfd, ev);
+    else modfd(m_epollfd, m_sockfd, ev);
+}
+
+bool HttpConn::read_space(char** buf, int* len) {
+    if (!ensure_read_space()) return false;
+    *buf = m_read_buf + m_read_idx;
+    *len = m_read_cap - 1 - m_read_idx;
+    return true;
+}
+
+void HttpConn::read_done(int n) {
+    m_read_idx += n;
+    m_bytes_received += n;
+}
+
 bool HttpConn::read_once() {
-    if(m_read_idx >= sizeof(m_read_buf)) return false;
     int bytes_read = 0;
+    // 上传内容由 worker 直接从 socket splice，这里不读，只派发
+    if (direct_read()) return true;
     while(true) {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, sizeof(m_read_buf) - m_read_idx, 0);
+        // 缓冲区满了先交给 process() 处理 (multipart 上传会边解析边腾出空间)；
+        // 处理完仍然放不下一个请求，由 process() 关闭连接
+        if(!ensure_read_space()) return m_read_idx > 0;
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_cap - 1 - m_read_idx, 0);
         if(bytes_read == -1) {
             if(errno == EAGAIN || errno == EWOULDBLOCK) break;
             return false;
         } else if(bytes_read == 0) return false;
         m_read_idx += bytes_read;
+        m_bytes_received += bytes_read;
     }
     return true;
 }
 
+// 找行尾用 SIMD 扫描 (HttpScan)，头部行在同一遍里记下第一个冒号的位置 (m_colon)
+// 行不完整时 m_checked_idx 停在已扫描的位置，下次接着扫
 HttpConn::LINE_STATUS HttpConn::parse_line() {
-    char temp;
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx) {
-        temp = m_read_buf[m_checked_idx];
-        if (temp == '\r') {
-            if ((m_checked_idx + 1) == m_read_idx) return LINE_OPEN;
-            else if (m_read_buf[m_checked_idx + 1] == '\n') {
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        } else if (temp == '\n') {
-            if ((m_checked_idx > 1) && (m_read_buf[m_checked_idx - 1] == '\r')) {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        }
+    if (m_checked_idx == m_start_line) m_colon = -1; // 新的一行
+    const char* begin = m_read_buf + m_checked_idx;
+    const char* end = m_read_buf + m_read_idx;
+    const char* hit;
+    if (m_check_state == CHECK_STATE_HEADER && m_colon < 0) {
+        const char* colon;
+        hit = HttpScan::find_eol_colon(begin, end, &colon);
+        if (colon) m_colon = colon - m_read_buf;
+    } else {
+        hit = HttpScan::find_eol(begin, end);
     }
-    return LINE_OPEN;
+    m_checked_idx = hit - m_read_buf;
+
+    if (hit == end) return LINE_OPEN;
+    if (*hit == '\n') return LINE_BAD;            // 没有 \r 的裸 \n
+    if (hit + 1 == end) return LINE_OPEN;         // \r 恰好是最后一个字节，等下一批数据
+    if (hit[1] != '\n') return LINE_BAD;
+    m_line_end = m_checked_idx;
+    m_read_buf[m_checked_idx++] = '\0';
+    m_read_buf[m_checked_idx++] = '\0';
+    return LINE_OK;
 }
 
 HttpConn::HTTP_CODE HttpConn::parse_request_line(char* text) {
-    m_url = strpbrk(text, " \t");
-    if (!m_url) return BAD_REQUEST;
+    char* end = m_read_buf + m_line_end;
+    m_url = (char*)HttpScan::find_space(text, end);
+    if (m_url == end) return BAD_REQUEST;
     *m_url++ = '\0';
     
     char* method = text;
@@ -177,8 +322,8 @@ HttpConn::HTTP_CODE HttpConn::parse_request_line(char* text) {
     else return BAD_REQUEST;
     
     m_url += strspn(m_url, " \t");
-    m_version = strpbrk(m_url, " \t");
-    if (!m_version) return BAD_REQUEST;
+    m_version = (char*)HttpScan::find_space(m_url, end);
+    if (m_version == end) return BAD_REQUEST;
     *m_version++ = '\0';
     if (strcasecmp(m_version, "HTTP/1.1") != 0) return BAD_REQUEST;
     
@@ -196,68 +341,119 @@ HttpConn::HTTP_CODE HttpConn::parse_request_line(char* text) {
 
 HttpConn::HTTP_CODE HttpConn::parse_headers(char* text) {
     if (text[0] == '\0') {
-        if (m_content_length != 0) {
+        if (m_content_length != 0 || m_chunked) {
             m_check_state = CHECK_STATE_CONTENT;
+            if (m_is_multipart) {
+                if (!m_upload) return BAD_REQUEST;  // 没有 boundary
+                m_upload->state = MP_PREAMBLE;
+                m_upload->remaining = m_content_length;
+                m_upload->direct = false;
+            }
             return NO_REQUEST;
         }
         return GET_REQUEST; 
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0) {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0) {
-            m_linger = true;
-        }
-    }
-    else if (strncasecmp(text, "Content-Length:", 15) == 0) {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    }
-    else if (strncasecmp(text, "Host:", 5) == 0) {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
-    }
-    else if (strncasecmp(text, "Cookie:", 7) == 0) {
-        text += 7;
-        text += strspn(text, " \t");
-        // LOG_INFO("Cookie: %s", text); // 调试时可以打印看看
-        
-        // 简单粗暴的判断：只要 Cookie 里包含 "is_login=true" 字符串，就算登录了
-        if (strstr(text, "is_login=true")) {
-            m_cookie_is_login = true;
-        }
-    }
-    else if (strncasecmp(text, "Content-Type:", 13) == 0) {
-    text += 13;
+
+    // 冒号位置由 parse_line 扫描行尾时顺带找出，名字和值不用再扫一遍
+    if (m_colon < 0) return NO_REQUEST; // 不是 "名字: 值" 格式的行，忽略
+    const char* name = text;
+    int name_len = (m_read_buf + m_colon) - text;
+    text += name_len + 1;
     text += strspn(text, " \t");
-    
-    // 检查是不是 multipart/form-data
-    if (strncasecmp(text, "multipart/form-data", 19) == 0) {
-        m_is_multipart = true; // 标记为文件上传
-        
-        // 寻找 boundary 的位置
-        // 格式通常是: multipart/form-data; boundary=----WebKitFormBoundary...
-        char* boundary_pos = strstr(text, "boundary=");
-        if (boundary_pos) {
-            boundary_pos += 9; // 跳过 "boundary=" 这9个字符
-            strcpy(m_boundary, boundary_pos); // 存下分界线
+
+    // 编译期完美哈希查表，已知头部再多也只比较一次
+    switch (lookup_header(name, name_len)) {
+        case HDR_CONNECTION:
+            if (strcasecmp(text, "keep-alive") == 0) {
+                m_linger = true;
             }
-        }
-    }   
+            break;
+        case HDR_CONTENT_LENGTH:
+            m_content_length = strtoll(text, nullptr, 10);
+            if (m_content_length < 0) return BAD_REQUEST;
+            break;
+        case HDR_ACCEPT_ENCODING:
+            m_accept_enc = parse_accept_encoding(text);
+            break;
+        case HDR_TRANSFER_ENCODING:
+            // 只支持 chunked：其他编码 (比如 gzip) 没法判断请求体在哪里结束，也没法交给业务处理
+            // 同时带 Content-Length 时以 chunked 为准
+            if (strcasecmp(text, "chunked") != 0) return BAD_REQUEST;
+            m_chunked = true;
+            break;
+        case HDR_RANGE:
+            m_range = text;
+            break;
+        case HDR_IF_RANGE:
+            m_if_range = text;
+            break;
+        case HDR_IF_NONE_MATCH:
+            m_if_none_match = text;
+            break;
+        case HDR_IF_MODIFIED_SINCE:
+            m_if_modified_since = text;
+            break;
+        case HDR_HOST:
+            m_host = text;
+            break;
+        case HDR_COOKIE:
+            // LOG_INFO("Cookie: %s", text); // 调试时可以打印看看
+            
+            // 简单粗暴的判断：只要 Cookie 里包含 "is_login=true" 字符串，就算登录了
+            if (strstr(text, "is_login=true")) {
+                m_cookie_is_login = true;
+            }
+            break;
+        case HDR_CONTENT_TYPE:
+            // 检查是不是 multipart/form-data
+            if (strncasecmp(text, "multipart/form-data", 19) == 0) {
+                m_is_multipart = true; // 标记为文件上传
+                
+                // 寻找 boundary 的位置
+                // 格式通常是: multipart/form-data; boundary=----WebKitFormBoundary...
+                // boundary 也可能带引号，或者后面还跟着别的参数
+                char* boundary_pos = strstr(text, "boundary=");
+                if (boundary_pos) {
+                    boundary_pos += 9; // 跳过 "boundary=" 这9个字符
+                    if (*boundary_pos == '"') ++boundary_pos;
+                    size_t len = strcspn(boundary_pos, "\"; \t");
+                    // 分界线在请求体里的形式是 "\r\n--boundary" (第一个前面没有 \r\n，解析时单独处理)
+                    char delim[Horspool::MAX_LEN];
+                    if (len == 0 || len + 4 > sizeof(delim)) return BAD_REQUEST;
+                    memcpy(delim, "\r\n--", 4);
+                    memcpy(delim + 4, boundary_pos, len);
+                    if (!m_upload) m_upload = new UploadInfo;
+                    m_upload->delim.init(delim, len + 4);
+                }
+            }
+            break;
+        default:
+            break;
+    }
     return NO_REQUEST;
 }
 
 HttpConn::HTTP_CODE HttpConn::parse_content(char* text) {
+    // 【新增】如果是 multipart 格式，边收边解析，不等整个请求体进缓冲区
+    if (m_is_multipart) {
+        return parse_multipart();
+    }
+
+    // chunked：就地解码，最后一块收齐后按普通请求体处理
+    if (m_chunked) {
+        ChunkedDecoder::STATUS st = m_chunk.decode(text, m_read_idx - m_checked_idx);
+        if (st == ChunkedDecoder::BAD) return BAD_REQUEST;
+        if (st == ChunkedDecoder::NEED_MORE) return NO_REQUEST;
+        m_content_length = m_chunk.body();
+        text[m_content_length] = '\0';
+        m_string = text;
+        return GET_REQUEST;
+    }
+
     // 判断是否读取了完整的 Body
     if (m_read_idx >= (m_content_length + m_checked_idx)) {
+        m_end_byte = text[m_content_length]; // 可能是流水线里下一个请求的第一个字节
         text[m_content_length] = '\0';
-        
-        // 【新增】如果是 multipart 格式，调用专门的解析函数
-        if (m_is_multipart) {
-            return parse_multipart_content(text);
-        }
 
         // 原有的普通 POST 处理逻辑 (比如登录注册)
         m_string = text;
@@ -266,88 +462,304 @@ HttpConn::HTTP_CODE HttpConn::parse_content(char* text) {
     return NO_REQUEST;
 }
 
-// 【新增】解析文件上传的核心逻辑
-HttpConn::HTTP_CODE HttpConn::parse_multipart_content(char* text) {
-    // 1. 构造完整的 boundary 字符串 (格式通常是 --boundary)
-    char boundary_str[200];
-    snprintf(boundary_str, 200, "--%s", m_boundary);
-    int boundary_len = strlen(boundary_str);
+// 从 part 头部里取 Content-Disposition 的参数 (name="..." / filename="...")
+// key 前面必须是分隔符，避免 name= 匹配到 filename= 的后半截
+static bool disposition_param(const char* headers, const char* key, char* out, size_t cap) {
+    size_t key_len = strlen(key);
+    for (const char* p = strstr(headers, key); p; p = strstr(p + 1, key)) {
+        if (p != headers && p[-1] != ';' && p[-1] != ' ' && p[-1] != '\t') continue;
+        p += key_len;
+        if (*p != '"') return false;
+        ++p;
+        const char* end = strchr(p, '"');
+        if (!end) return false;
+        size_t len = end - p;
+        if (len >= cap) len = cap - 1;
+        memcpy(out, p, len);
+        out[len] = '\0';
+        return true;
+    }
+    return false;
+}
 
-    // 2. 解析头部，获取文件名
-    // 格式示例: Content-Disposition: form-data; name="file"; filename="avatar.jpg"
-    
-    // 跳过第一行 boundary
-    char* start_headers = strstr(text, "\r\n");
-    if (!start_headers) return BAD_REQUEST;
-    start_headers += 2; // 跳过 \r\n
-
-    // 查找 filename 字段
-    char* filename_ptr = strstr(start_headers, "filename=\"");
-    if (!filename_ptr) return BAD_REQUEST;
-    filename_ptr += 10; // 跳过 filename=" 这10个字符
-
-    // 找到文件名结束的引号
-    char* end_filename = strchr(filename_ptr, '"');
-    if (!end_filename) return BAD_REQUEST;
-    
-    // 提取文件名
-    int name_len = end_filename - filename_ptr;
-    if (name_len >= 99) name_len = 99;
-    strncpy(m_upload_filename, filename_ptr, name_len);
-    m_upload_filename[name_len] = '\0';
-    
-    LOG_INFO("Detected Upload File: %s", m_upload_filename);
+// 一个 part 的头部收齐了：带 filename 的存成文件，不带的当作普通表单字段
+bool HttpConn::open_part(char* headers) {
+    UploadInfo* up = m_upload;
+    up->fd = -1;
+    up->is_field = false;
+    up->part_size = 0;
+    up->value.clear();
+    if (!disposition_param(headers, "name=", up->name, sizeof(up->name))) up->name[0] = '\0';
+
+    char filename[100];
+    if (!disposition_param(headers, "filename=", filename, sizeof(filename))) {
+        up->is_field = true;
+        return true;
+    }
+    // 只取最后一段，防止 "../" 之类的路径写到资源目录外面；没选文件时 filename 为空，内容直接丢弃
+    const char* base = filename;
+    for (const char* p = filename; *p; ++p) {
+        if (*p == '/' || *p == '\\') base = p + 1;
+    }
+    if (*base == '\0' || strcmp(base, ".") == 0 || strcmp(base, "..") == 0) return true;
+
+    LOG_INFO("Detected Upload File: %s", base);
+    // 保存到资源目录下，文件名前加 upload_ 前缀
+    snprintf(up->path, sizeof(up->path), "%s/upload_%s", doc_root, base);
+    up->fd = open(up->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (up->fd < 0) {
+        LOG_ERROR("Open file failed: %s", up->path);
+        return false;
+    }
+    // 文件大小不会超过剩余的请求体：先按这个长度分配好磁盘块，减少边写边分配和碎片
+    // KEEP_SIZE 不改变文件长度，写完再截掉多分配的部分；文件系统不支持就算了
+    up->prealloc = !m_chunked && up->remaining >= SPLICE_MIN
+                   && fallocate(up->fd, FALLOC_FL_KEEP_SIZE, 0, up->remaining) == 0;
+    return true;
+}
 
-    // 3. 寻找二进制数据的起始位置
-    // 数据开始于头部之后的第一个空行 (\r\n\r\n)
-    char* data_start = strstr(end_filename, "\r\n\r\n");
-    if (!data_start) return BAD_REQUEST;
-    data_start += 4; // 跳过 \r\n\r\n，指针现在指向图片数据的第一个字节
+bool HttpConn::write_part(const char* data, size_t len) {
+    UploadInfo* up = m_upload;
+    if (up->is_field) {
+        if (up->value.size() < MAX_FORM_FIELD) up->value.append(data, min(len, MAX_FORM_FIELD - up->value.size()));
+        return true;
+    }
+    if (up->fd < 0) return true;
+    up->part_size += len;
+    while (len > 0) {
+        ssize_t n = ::write(up->fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Write file failed: %s", up->path);
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
 
-    // 4. 计算文件大小 (这是最难的一步)
-    // 因为图片数据里可能包含 \0，所以不能用 strlen。
-    // 我们必须根据 m_content_length (总长度) 减去头部和尾部来计算。
-    
-    int total_len = m_content_length;
-    int header_offset = data_start - text; // 头部占用的长度
-    int data_len_with_footer = total_len - header_offset; // 剩余部分长度(含尾部 boundary)
-
-    // 尾部通常是: \r\n--boundary--\r\n
-    // 我们通过暴力搜索找到尾部 boundary 的位置
-    char* data_end = nullptr;
-    for (int i = 0; i < data_len_with_footer - boundary_len; ++i) {
-        // 查找特征: \r\n + boundary
-        if (memcmp(data_start + i, "\r\n", 2) == 0) {
-             if (memcmp(data_start + i + 2, boundary_str, boundary_len) == 0) {
-                 data_end = data_start + i;
-                 break;
-             }
+void HttpConn::close_part() {
+    UploadInfo* up = m_upload;
+    if (up->fd >= 0) {
+        if (up->prealloc && ftruncate(up->fd, up->part_size) < 0) {
+            LOG_WARN("Truncate file failed: %s", up->path);
+        }
+        close(up->fd);
+        up->fd = -1;
+        LOG_INFO("File Saved Successfully: %s (Size: %lld bytes)", up->path, up->part_size);
+    } else if (up->is_field) {
+        LOG_INFO("Upload form field: %s=%s", up->name, up->value.c_str());
+    }
+    up->is_field = false;
+    up->prealloc = false;
+}
+
+// 每个 worker 线程一根管道，作为 socket -> 文件 splice 的中转
+static int* splice_pipe() {
+    static thread_local int fds[2] = { -1, -1 };
+    if (fds[0] < 0) {
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            fds[0] = fds[1] = -1;
+            return nullptr;
         }
+        fcntl(fds[1], F_SETPIPE_SZ, 1024 * 1024); // 失败就用默认的 64KB
     }
-    if (!data_end) return BAD_REQUEST;
+    return fds;
+}
 
-    int file_size = data_end - data_start;
+// 出错时管道里可能残留数据，直接换一根新的
+static void drop_splice_pipe() {
+    int* fds = splice_pipe();
+    if (!fds) return;
+    close(fds[0]);
+    close(fds[1]);
+    fds[0] = fds[1] = -1;
+}
 
-    // 5. 保存文件到本地 (简单的文件 IO)
-    // 假设保存到当前运行目录，或者你可以指定 resources/ 目录
-    char file_path[256];
-    // 这里为了演示方便，直接存到 server_core 同级目录下，文件名前加 upload_ 前缀
-    snprintf(file_path, 256, "resources/upload_%s", m_upload_filename);
+// 把 socket 里接下来的 len 字节搬进当前文件，数据不经过用户态
+bool HttpConn::splice_to_file(size_t len) {
+    int* pfd = splice_pipe();
+    if (!pfd) return false;
+    while (len > 0) {
+        ssize_t in = splice(m_sockfd, nullptr, pfd[1], nullptr, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (in < 0 && errno == EINTR) continue;
+        if (in <= 0) {
+            drop_splice_pipe();
+            return false;
+        }
+        for (ssize_t left = in; left > 0; ) {
+            ssize_t out = splice(pfd[0], nullptr, m_upload->fd, nullptr, left, SPLICE_F_MOVE);
+            if (out < 0 && errno == EINTR) continue;
+            if (out <= 0) {
+                LOG_ERROR("Splice to file failed: %s", m_upload->path);
+                drop_splice_pipe();
+                return false;
+            }
+            left -= out;
+        }
+        len -= in;
+        m_bytes_received += in;
+        m_upload->part_size += in;
+        m_upload->remaining -= in;
+    }
+    return true;
+}
 
-    FILE* fp = fopen(file_path, "wb"); // wb: 二进制写入模式
-    if (!fp) {
-        LOG_ERROR("Open file failed: %s", file_path);
-        return INTERNAL_ERROR;
+// 文件 part 的大块内容：MSG_PEEK 看一眼 socket 里的数据找分界线 (只有这一次拷贝)，
+// 确认不是分界线的字节用 splice 直接从 socket 搬进文件，不再 recv 进读缓冲区再 write 出去
+// 读缓冲区里只剩可能是分界线前半截的尾巴，peek 的数据接在它后面，跨界的分界线也能找到
+// 返回 0: socket 暂时没数据  1: 分界线就在前面 (或数据太少)，回到 recv 路径  -1: 对端断开  -2: 写文件失败
+int HttpConn::splice_part() {
+    UploadInfo* up = m_upload;
+    const int delim_len = up->delim.size();
+    if (m_read_cap < SPLICE_CHUNK) {
+        char* old_buf = m_read_buf;
+        if (!buffers()->grow(&m_read_buf, &m_read_cap, m_read_idx, SPLICE_CHUNK)) return 1;
+        rebase_read_ptrs(old_buf);
+    }
+    while (true) {
+        int tail = m_read_idx - m_checked_idx;
+        long long left = up->remaining - tail;    // 还在 socket 里的请求体
+        if (left < SPLICE_MIN) return 1;
+        size_t want = min((long long)(m_read_cap - 1 - m_read_idx), left);
+        ssize_t n = recv(m_sockfd, m_read_buf + m_read_idx, want, MSG_PEEK);
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        if (n == 0) return -1;
+
+        const char* begin = m_read_buf + m_checked_idx;
+        const char* end = m_read_buf + m_read_idx + n;
+        const char* hit = up->delim.find(begin, end);
+        long long safe = hit != end ? hit - begin : (end - begin) - (delim_len - 1);
+        if (safe <= tail) return 1;
+
+        // 缓冲区里的尾巴确定不是分界线，先写掉，然后 socket 里的 safe - tail 字节直接搬
+        if (!write_part(begin, tail)) return -2;
+        m_read_idx = m_checked_idx;
+        up->remaining -= tail;
+        if (!splice_to_file(safe - tail)) return -2;
+        if (hit != end) return 1;
     }
-    fwrite(data_start, 1, file_size, fp);
-    fclose(fp);
+}
 
-    LOG_INFO("File Saved Successfully: %s (Size: %d bytes)", file_path, file_size);
+// 【新增】multipart/form-data 流式解析
+// 每次只处理缓冲区里已经收到的那部分请求体：文件内容直接写盘，处理完的字节从读缓冲区里挪走，
+// 缓冲区里最多只留一个没收全的 part 头部，或不足一个分界线长度的尾巴，所以上传大小不受读缓冲区限制
+HttpConn::HTTP_CODE HttpConn::parse_multipart() {
+    UploadInfo* up = m_upload;
+    char* begin = m_read_buf + m_checked_idx;
+    long long avail;
+    bool whole;   // 请求体剩下的部分已经全部在缓冲区里
+    if (m_chunked) {
+        // chunked 上传先就地解码，解出来的数据在 begin 开头，照常解析
+        ChunkedDecoder::STATUS st = m_chunk.decode(begin, m_read_idx - m_checked_idx);
+        if (st == ChunkedDecoder::BAD) return BAD_REQUEST;
+        avail = m_chunk.body();
+        whole = st == ChunkedDecoder::DONE;
+    } else {
+        avail = m_read_idx - m_checked_idx;
+        whole = avail >= up->remaining;
+        if (whole) avail = up->remaining;
+    }
+    char* p = begin;
+    char* end = begin + avail;
+    bool try_splice = false;
+    up->direct = false;
+    const char* delim = up->delim.pattern();
+    const int delim_len = up->delim.size();
+
+    bool more = true;
+    while (more) {
+        switch (up->state) {
+            case MP_PREAMBLE: {
+                // 第一个分界线前面没有 \r\n，直接找 "--boundary"
+                char* hit = (char*)memmem(p, end - p, delim + 2, delim_len - 2);
+                if (!hit) {
+                    if (end - p > delim_len) p = end - delim_len;  // 分界线前的内容直接丢弃
+                    more = false;
+                    break;
+                }
+                p = hit + delim_len - 2;
+                up->state = MP_DELIM;
+                break;
+            }
+            case MP_DELIM:
+                if (end - p < 2) { more = false; break; }
+                if (p[0] == '-' && p[1] == '-') up->state = MP_EPILOGUE;
+                else if (p[0] == '\r' && p[1] == '\n') up->state = MP_HEADERS;
+                else return BAD_REQUEST;
+                p += 2;
+                break;
+            case MP_HEADERS: {
+                // 头部要完整收到才解析；没有头部的 part 紧跟一个空行
+                char* hit = (end - p >= 2 && p[0] == '\r' && p[1] == '\n')
+                    ? p : (char*)memmem(p, end - p, "\r\n\r\n", 4);
+                if (!hit) {
+                    if (end - p > MAX_PART_HEADER) return BAD_REQUEST;
+                    more = false;
+                    break;
+                }
+                if (hit - p > MAX_PART_HEADER) return BAD_REQUEST;
+                *hit = '\0';
+                if (!open_part(p)) {
+                    m_linger = false;  // 请求体没读完，连接不能再复用
+                    return INTERNAL_ERROR;
+                }
+                p = hit + (hit == p ? 2 : 4);
+                up->state = MP_DATA;
+                break;
+            }
+            case MP_DATA: {
+                // 没找到分界线时，末尾不足一个分界线长度的字节可能是分界线的前半截，留到下次
+                const char* hit = up->delim.find(p, end);
+                const char* stop = hit;
+                if (hit == end) stop = end - p > delim_len ? end - (delim_len - 1) : p;
+                if (!write_part(p, stop - p)) {
+                    m_linger = false;
+                    return INTERNAL_ERROR;
+                }
+                p = (char*)stop;
+                if (hit == end) {
+                    try_splice = up->fd >= 0 && !whole && !m_chunked;  // chunked 的分块格式夹在数据里，不能直接 splice
+                    more = false;
+                    break;
+                }
+                p += delim_len;
+                close_part();
+                up->state = MP_DELIM;
+                break;
+            }
+            case MP_EPILOGUE:
+                p = end;
+                more = false;
+                break;
+        }
+    }
 
-    // 6. 修改跳转逻辑
-    // 上传成功后，我们不想让用户看到白屏，而是跳回欢迎页或者成功页
-    m_url = "/welcome.html"; 
+    // 已处理的字节从缓冲区里挪走，后面 (未处理的请求体和流水线里的下一个请求) 前移
+    int used = p - begin;
+    memmove(begin, p, m_read_idx - m_checked_idx - used);
+    m_read_idx -= used;
+    if (m_chunked) m_chunk.consume(used);
+    else up->remaining -= used;
+    if (!whole) {
+        // 缓冲区处理完了，文件剩下的内容尽量直接从 socket splice 进文件
+        if (try_splice) {
+            int r = splice_part();
+            if (r == -1) return BAD_REQUEST;
+            if (r == -2) {
+                m_linger = false;
+                return INTERNAL_ERROR;
+            }
+            up->direct = r == 0;
+        }
+        return NO_REQUEST;
+    }
+    // 请求体已经收全却没走到结束分界线
+    if (up->state != MP_EPILOGUE) return BAD_REQUEST;
 
+    // 上传成功后，我们不想让用户看到白屏，而是跳回欢迎页
+    m_url = (char*)"/welcome.html";
     return GET_REQUEST;
 }
 
@@ -371,31 +783,31 @@ HttpConn::HTTP_CODE HttpConn::process_read() {
             case CHECK_STATE_CONTENT:
                 ret = parse_content(text); 
                 if (ret == GET_REQUEST) return do_request();
-                line_status = LINE_OPEN;
-                break;
+                if (ret != NO_REQUEST) return ret;
+                // 请求体还没收齐：直接返回等下一批数据。
+                // 不能再回到循环条件里调用 parse_line()，它会把请求体里的 \r\n 改写成 \0 并推进 m_checked_idx
+                return NO_REQUEST;
             default: return INTERNAL_ERROR;
         }
     }
+    // 畸形的行 (比如裸 \n) 直接判为坏请求，而不是一直等数据直到超时
+    if (line_status == LINE_BAD) return BAD_REQUEST;
     return NO_REQUEST;
 }
 
 HttpConn::HTTP_CODE HttpConn::do_request() {
-    char path[200];
-    strcpy(path, doc_root);
-    int len = strlen(doc_root);
-    
     if (!m_url) {
         return BAD_REQUEST;
     }
 
     // 1. 拦截未登录访问 (保持原样)
-    if ((strcasecmp(m_url, "/welcome.html") == 0 || strcasecmp(m_url, "/media.html") == 0) 
+    if ((strcasecmp(m_url, "/welcome.html") == 0 || strcasecmp(m_url, "/media.html") == 0
+         || strcasecmp(m_url, "/uploads") == 0)
         && !m_cookie_is_login) {
-        strcpy(m_url, "/logError.html"); 
+        // m_url 可能指向常量字符串 (上传成功后的 "/welcome.html")，不能原地改写
+        m_url = (char*)"/logError.html"; 
     }
 
-    const char *p = strrchr(m_url, '/');
-    
     // ========================================================
     // 2. 登录/注册逻辑 (主要修改这里)
     // ========================================================
@@ -481,152 +893,478 @@ HttpConn::HTTP_CODE HttpConn::do_request() {
 
     if (strcasecmp(m_url, "/") == 0) strcpy(m_url, "/index.html");
 
-    m_real_file = new char[200];
-    strncpy(m_real_file, path, 200);
-    int path_len = strlen(path);
-    strncpy(m_real_file + path_len, m_url, 200 - path_len);
+    // 已上传文件的列表是现生成的页面，不走静态文件缓存
+    if (m_method == GET && strcasecmp(m_url, "/uploads") == 0) return LIST_REQUEST;
 
-    if (stat(m_real_file, &m_file_stat) < 0) return NO_RESOURCE;
-    if (!(m_file_stat.st_mode & S_IROTH)) return FORBIDDEN_REQUEST;
-    if (S_ISDIR(m_file_stat.st_mode)) return BAD_REQUEST;
-    
-    int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char*)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
+    // 走静态文件缓存：命中时不 stat/open，响应头也是预先拼好的
+    int err = 0;
+    m_file = FileCache::Instance()->get(doc_root, m_url, &err);
+    if (err == EACCES) return FORBIDDEN_REQUEST;
+    if (err == EISDIR) return BAD_REQUEST;
+    if (!m_file) return NO_RESOURCE;
     
     return FILE_REQUEST;
 }
 
-void HttpConn::unmap() {
-    if (m_file_address) {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+void HttpConn::push_seg(SEG_TYPE type, int fd, bool own_fd, const char* data, off_t offset, size_t len) {
+    SendSeg seg;
+    seg.type = type;
+    seg.fd = fd;
+    seg.own_fd = own_fd;
+    seg.data = data;
+    seg.offset = offset;
+    seg.len = len;
+    m_send_q.push_back(seg);
+    m_bytes_to_send += len;
+}
+
+// 已发出 n 字节：推进发送队列，部分写之后下次从断点继续，而不是从头重发
+void HttpConn::advance(size_t n) {
+    m_bytes_sent += n;
+    m_bytes_have_send += n;
+    m_bytes_to_send -= n;
+    while (m_send_head < m_send_q.size()) {
+        SendSeg& seg = m_send_q[m_send_head];
+        size_t step = min(n, seg.len);
+        if (seg.type == SEG_MEM) seg.data += step;
+        else seg.offset += step;
+        seg.len -= step;
+        n -= step;
+        if (seg.len > 0) break;
+        if (seg.own_fd) close(seg.fd);
+        seg.own_fd = false;
+        ++m_send_head;
     }
 }
 
-bool HttpConn::write() {
-    int temp = 0;
-    int bytes_have_send = 0;
-    int bytes_to_send = m_write_idx + m_file_stat.st_size; 
+// 丢弃队列里剩余的段 (响应发完或连接关闭)，关闭队列持有的文件
+void HttpConn::clear_send_queue() {
+    for (size_t i = m_send_head; i < m_send_q.size(); ++i) {
+        if (m_send_q[i].own_fd) close(m_send_q[i].fd);
+    }
+    m_send_q.clear();
+    m_send_head = 0;
+    m_bytes_to_send = 0;
+    m_bytes_have_send = 0;
+    m_file.reset();
+    m_files.clear();
+    m_chunks.clear();
+}
 
-    if (bytes_to_send == 0) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
-        init_parse_state();
-        return true;
+// 一批响应发送完毕：长连接清空发送状态继续读，否则返回 false 由调用者关闭
+// 读缓冲区里还有流水线请求的字节时保留读缓冲区
+bool HttpConn::finish_response() {
+    if (!m_keep_alive) return false;
+    clear_send_queue();
+    m_write_idx = 0;
+    if (m_read_idx == 0) release_buffers();
+    return true;
+}
+
+int HttpConn::write_iov(struct iovec* iov, int max, bool* file_follows) {
+    int cnt = 0;
+    size_t i = m_send_head;
+    for (; i < m_send_q.size() && cnt < max; ++i) {
+        const SendSeg& seg = m_send_q[i];
+        if (seg.type == SEG_FILE) break;
+        if (seg.len == 0) continue;
+        iov[cnt].iov_base = (void*)(seg.type == SEG_WBUF ? m_write_buf + seg.offset : seg.data);
+        iov[cnt].iov_len = seg.len;
+        ++cnt;
     }
+    if (file_follows) *file_follows = i < m_send_q.size() && m_send_q[i].type == SEG_FILE;
+    return cnt;
+}
 
-    while (1) {
-        temp = writev(m_sockfd, m_iv, m_iv_count);
-        if (temp <= -1) {
-            if (errno == EAGAIN) {
-                modfd(m_epollfd, m_sockfd, EPOLLOUT);
-                return true;
-            }
-            unmap();
-            return false;
+HttpConn::SEND_STATUS HttpConn::send_some() {
+    size_t budget = SEND_BUDGET;
+    while (m_bytes_to_send > 0) {
+        SendSeg& seg = m_send_q[m_send_head];
+        ssize_t n;
+        if (seg.type == SEG_FILE) {
+            // 大文件分块发送：sendfile 自己推进 offset，这里传副本，统一交给 advance()
+            off_t off = seg.offset;
+            n = sendfile(m_sockfd, seg.fd, &off, min(seg.len, SENDFILE_CHUNK));
+            if (n == 0) return SEND_ERROR; // 文件在发送过程中被截断
+        } else {
+            struct iovec iov[MAX_IOV];
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            bool file_follows = false;
+            msg.msg_iov = iov;
+            msg.msg_iovlen = write_iov(iov, MAX_IOV, &file_follows);
+            // 后面紧跟文件段时带 MSG_MORE，让响应头和文件开头合并成同一批报文，
+            // 否则头部单独成包，文件数据要等 Nagle + 对端延迟 ACK (~40ms)
+            n = sendmsg(m_sockfd, &msg, MSG_NOSIGNAL | (file_follows ? MSG_MORE : 0));
         }
-        bytes_to_send -= temp;
-        bytes_have_send += temp;
-        
-        if (bytes_to_send <= 0) {
-            unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN); 
-            if (m_linger) { 
-                init_parse_state();
-                return true;
-            } else {
-                return false;
-            }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return SEND_AGAIN;
+            if (errno == EINTR) continue;
+            return SEND_ERROR;
         }
+        advance(n);
+        if ((size_t)n >= budget) return m_bytes_to_send > 0 ? SEND_YIELD : SEND_DONE;
+        budget -= n;
     }
+    return SEND_DONE;
 }
 
-bool HttpConn::add_response(const char* format, ...) {
-    // 【核心修复】增加 (int) 强制转换，解决 comparison 警告
-    if (m_write_idx >= (int)sizeof(m_write_buf)) return false; 
-    
-    va_list arg_list;
-    va_start(arg_list, format);
-    int len = vsnprintf(m_write_buf + m_write_idx, sizeof(m_write_buf) - 1 - m_write_idx, format, arg_list);
-    
-    // 【核心修复】增加 (int) 强制转换
-    if (len >= (int)(sizeof(m_write_buf) - 1 - m_write_idx)) return false; 
-    
+int HttpConn::write() {
+    switch (send_some()) {
+        case SEND_DONE: {
+            int state = write_done(0);
+            // 还有没处理的流水线请求时不重新注册事件，由调用者直接再派发一次 process()
+            // write() 在 loop 线程里调用，定时器一直挂着，直接改 epoll 即可
+            if (state == 0) modfd(m_epollfd, m_sockfd, EPOLLIN);
+            return state;
+        }
+        case SEND_AGAIN:
+        case SEND_YIELD:
+            // 没发完：记住进度，等下一次 EPOLLOUT 续传 (慢客户端不会一直占着 loop)
+            modfd(m_epollfd, m_sockfd, EPOLLOUT);
+            return 1;
+        default:
+            return -1;
+    }
+}
+
+int HttpConn::write_done(int n) {
+    advance(n);
+    if (m_bytes_to_send > 0) return 1;
+    if (!finish_response()) return -1;
+    if (m_pipeline_pending) {
+        m_pipeline_pending = false;
+        return 2;
+    }
+    return 0;
+}
+
+// 保证写缓冲区还能再放 n 个字节
+// 流水线里多个响应头共用写缓冲区，放不下就按 2 倍扩容 (发送队列记的是偏移，搬家不影响)
+bool HttpConn::reserve_write(size_t n) {
+    if (!ensure_write_buf()) return false;
+    while (m_write_cap - m_write_idx < n) {
+        if (m_write_cap >= (size_t)WRITE_BUFFER_MAX) return false;
+        if (!buffers()->grow(&m_write_buf, &m_write_cap, m_write_idx, m_write_cap * 2)) return false;
+    }
+    return true;
+}
+
+bool HttpConn::add_bytes(const char* data, size_t len) {
+    if (!reserve_write(len)) return false;
+    memcpy(m_write_buf + m_write_idx, data, len);
     m_write_idx += len;
-    va_end(arg_list);
+    return true;
+}
+
+bool HttpConn::add_number(unsigned long long v) {
+    if (!reserve_write(20)) return false;
+    m_write_idx += http_itoa(m_write_buf + m_write_idx, v);
     return true;
 }
 
 bool HttpConn::add_content(const char* content) {
-    // 调用你现有的 add_response，把内容格式化进去
-    return add_response("%s", content);
+    return add_bytes(content, strlen(content));
 }
 
-bool HttpConn::add_status_line(int status, const char* title) {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+bool HttpConn::add_status_line(int status) {
+    return add_text(http_status_line(status));
 }
 bool HttpConn::add_headers(int content_len) {
     add_content_length(content_len);
     add_content_type();
-    add_response("Connection: %s\r\n", (m_linger == true) ? "keep-alive" : "close");
     
     // 【关键修复】Cookie 必须在 add_blank_line 之前发送！
     // 只有这样，它才属于 Header，浏览器才会识别并存储。
     if (m_set_cookie == 1) {
-        add_response("Set-Cookie: is_login=true; Max-Age=3600; Path=/\r\n");
+        add_literal("Set-Cookie: is_login=true; Max-Age=3600; Path=/\r\n");
         m_set_cookie = 0; 
     }
 
-    // 这一行必须是最后一句！它代表 Header 结束，Body 开始。
-    add_blank_line(); 
-    return true;
+    // 这一步必须是最后一句！Date / Connection 之后的空行代表 Header 结束，Body 开始。
+    return end_headers();
 }
-bool HttpConn::add_content_length(int content_len) {
-    return add_response("Content-Length: %d\r\n", content_len);
+bool HttpConn::add_content_length(size_t content_len) {
+    return add_literal("Content-Length: ") && add_number(content_len) && add_literal("\r\n");
 }
 bool HttpConn::add_content_type() {
     // 1. 如果是 API 请求，返回 JSON
     if (m_is_json) {
-        return add_response("Content-Type:%s\r\n", "application/json;charset=utf-8");
+        return add_text(kHttpJson.header);
     }
 
-    // 2. 如果是文件请求，根据后缀名判断类型
-    // 获取文件名后缀 (比如 .jpg)
-    const char* suffix = strrchr(m_url, '.');
-    
-    if (suffix != nullptr) {
-        if (strcasecmp(suffix, ".html") == 0) return add_response("Content-Type:%s\r\n", "text/html");
-        if (strcasecmp(suffix, ".css")  == 0) return add_response("Content-Type:%s\r\n", "text/css");
-        if (strcasecmp(suffix, ".js")   == 0) return add_response("Content-Type:%s\r\n", "text/javascript");
-        if (strcasecmp(suffix, ".jpg")  == 0 || strcasecmp(suffix, ".jpeg") == 0) 
-            return add_response("Content-Type:%s\r\n", "image/jpeg");
-        if (strcasecmp(suffix, ".png")  == 0) return add_response("Content-Type:%s\r\n", "image/png");
-        if (strcasecmp(suffix, ".gif")  == 0) return add_response("Content-Type:%s\r\n", "image/gif");
-        if (strcasecmp(suffix, ".mp4")  == 0) return add_response("Content-Type:%s\r\n", "video/mp4");
-        // 如果想支持更多格式，可以在这里继续加
-    }
+    // 2. 如果是文件请求，根据后缀名判断类型 (和静态文件缓存共用一张表，未知类型兜底为 HTML)
+    return add_text(http_mime(m_url)->header);
+}
+
+// "Content-Range: bytes first-last/size\r\n"
+bool HttpConn::add_content_range(off_t first, off_t last, off_t size) {
+    return add_literal("Content-Range: bytes ") && add_number(first) && add_literal("-")
+        && add_number(last) && add_literal("/") && add_number(size) && add_literal("\r\n");
+}
 
-    // 3. 默认兜底：依然是 HTML (或者用 text/plain)
-    return add_response("Content-Type:%s\r\n", "text/html");
+bool HttpConn::add_validators(const char* etag, const char* last_modified) {
+    return add_literal("ETag: ") && add_content(etag) && add_literal("\r\nLast-Modified: ")
+        && add_content(last_modified) && add_literal("\r\n");
+}
+
+bool HttpConn::add_date() {
+    return add_bytes(HttpDate::line(), HttpDate::LEN);
+}
+
+bool HttpConn::add_linger() {
+    return m_linger ? add_literal("Connection: keep-alive\r\n") : add_literal("Connection: close\r\n");
 }
 
 bool HttpConn::add_blank_line() {
-    return add_response("\r\n");
+    return add_literal("\r\n");
+}
+
+// 所有响应共用的结尾：Date、Connection 和空行
+bool HttpConn::end_headers() {
+    return add_date() && add_linger() && add_blank_line();
+}
+
+// 判断 If-None-Match 列表里是否有和该文件某个版本相同的校验值 (弱比较，忽略 W/ 前缀)
+static bool etag_list_match(const char* list, const FileCache::Entry* f) {
+    while (*list) {
+        list += strspn(list, " \t,");
+        if (*list == '*') return true;
+        if (strncmp(list, "W/", 2) == 0) list += 2;
+        size_t len = strcspn(list, " \t,");
+        if (len == 0) break;
+        for (int i = 0; i < FileCache::ENC_NUM; ++i) {
+            if (f->etag[i][0] && strlen(f->etag[i]) == len && strncmp(f->etag[i], list, len) == 0) return true;
+        }
+        list += len;
+    }
+    return false;
+}
+
+// 条件请求：客户端缓存的版本仍然有效时返回 true (回 304，不发文件内容)
+// 同时带了 If-None-Match 时忽略 If-Modified-Since
+bool HttpConn::not_modified() {
+    const FileCache::Entry* f = m_file.get();
+    if (m_if_none_match) return etag_list_match(m_if_none_match, f);
+    if (m_if_modified_since) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char* end = strptime(m_if_modified_since, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        if (!end) return false;
+        return f->mtime <= timegm(&tm);
+    }
+    return false;
+}
+
+// 解析 "bytes=0-499, 1000-, -200" 形式的 Range，换算成按起点排序、合并重叠后的闭区间
+HttpConn::RANGE_STATUS HttpConn::parse_range(off_t size, ByteRange* ranges, int* count) {
+    if (!m_range || strncasecmp(m_range, "bytes=", 6) != 0) return RANGE_NONE;
+    // If-Range 可以是原始内容的强 ETag 或 Last-Modified 日期；对不上就当作普通请求返回整个文件
+    if (m_if_range && strcmp(m_if_range, m_file->etag[FileCache::ENC_IDENTITY]) != 0
+        && strcmp(m_if_range, m_file->last_modified) != 0) return RANGE_NONE;
+
+    int n = 0;
+    bool any_spec = false;
+    const char* p = m_range + 6;
+    while (*p) {
+        p += strspn(p, " \t,");
+        if (!*p) break;
+        any_spec = true;
+        char* end;
+        off_t first, last;
+        if (*p == '-') {
+            // 后缀区间：最后 N 个字节
+            long long suffix = strtoll(p + 1, &end, 10);
+            if (end == p + 1 || suffix < 0) return RANGE_NONE;
+            if (suffix == 0) { p = end; continue; }
+            first = suffix >= size ? 0 : size - suffix;
+            last = size - 1;
+        } else {
+            long long a = strtoll(p, &end, 10);
+            if (end == p || *end != '-' || a < 0) return RANGE_NONE;
+            p = end + 1;
+            if (*p >= '0' && *p <= '9') {
+                long long b = strtoll(p, &end, 10);
+                if (b < a) return RANGE_NONE;
+                last = b >= size ? size - 1 : b;
+            } else {
+                end = (char*)p;
+                last = size - 1;
+            }
+            first = a;
+            if (first >= size) { p = end; continue; }  // 越界的区间忽略
+        }
+        p = end;
+        p += strspn(p, " \t");
+        if (*p && *p != ',') return RANGE_NONE;
+        if (n == MAX_RANGES) return RANGE_NONE;
+        ranges[n].first = first;
+        ranges[n].last = last;
+        ++n;
+    }
+    if (!any_spec) return RANGE_NONE;
+    if (n == 0) return RANGE_UNSATISFIABLE;
+
+    // 排序并合并重叠/相邻区间，避免恶意的大量重叠区间放大流量
+    sort(ranges, ranges + n, [](const ByteRange& x, const ByteRange& y) { return x.first < y.first; });
+    int merged = 0;
+    for (int i = 1; i < n; ++i) {
+        if (ranges[i].first <= ranges[merged].last + 1) {
+            ranges[merged].last = max(ranges[merged].last, ranges[i].last);
+        } else {
+            ranges[++merged] = ranges[i];
+        }
+    }
+    *count = merged + 1;
+    return RANGE_OK;
+}
+
+// 206 响应：文件数据仍然走发送队列 (大文件 sendfile，小文件直接引用缓存内存)
+// 多个区间时用 multipart/byteranges，各段的分隔头写在写缓冲区里
+bool HttpConn::add_range_response(const ByteRange* ranges, int count) {
+#define BOUNDARY "TinyWebServerByteRanges"
+    const FileCache::Entry* f = m_file.get();
+    off_t size = f->size;
+
+    // 先把各段的分隔头写进写缓冲区并记下位置，总长度算出来以后再写响应头
+    int part_off[MAX_RANGES + 1], part_len[MAX_RANGES + 1];
+    size_t body_len = 0;
+    if (count > 1) {
+        for (int i = 0; i <= count; ++i) {
+            part_off[i] = m_write_idx;
+            bool ok = i < count
+                ? add_literal("\r\n--" BOUNDARY "\r\n") && add_text(f->mime->header)
+                  && add_content_range(ranges[i].first, ranges[i].last, size) && add_blank_line()
+                : add_literal("\r\n--" BOUNDARY "--\r\n");
+            if (!ok) return false;
+            part_len[i] = m_write_idx - part_off[i];
+            body_len += part_len[i];
+            if (i < count) body_len += ranges[i].last - ranges[i].first + 1;
+        }
+    } else {
+        body_len = ranges[0].last - ranges[0].first + 1;
+    }
+
+    int header_off = m_write_idx;
+    add_status_line(206);
+    add_content_length(body_len);
+    if (count > 1) {
+        add_literal("Content-Type: multipart/byteranges; boundary=" BOUNDARY "\r\n");
+    } else {
+        add_text(f->mime->header);
+        add_content_range(ranges[0].first, ranges[0].last, size);
+    }
+    add_validators(f->etag[FileCache::ENC_IDENTITY], f->last_modified);
+    add_literal("Accept-Ranges: bytes\r\n");
+    if (f->vary) add_literal("Vary: Accept-Encoding\r\n");
+    if (!end_headers()) return false;
+    push_seg(SEG_WBUF, -1, false, nullptr, header_off, m_write_idx - header_off);
+
+    for (int i = 0; i < count; ++i) {
+        if (count > 1) push_seg(SEG_WBUF, -1, false, nullptr, part_off[i], part_len[i]);
+        size_t len = ranges[i].last - ranges[i].first + 1;
+        if (f->fd >= 0) push_seg(SEG_FILE, f->fd, false, nullptr, ranges[i].first, len);
+        else push_seg(SEG_MEM, -1, false, f->body[FileCache::ENC_IDENTITY].data() + ranges[i].first, 0, len);
+    }
+    if (count > 1) push_seg(SEG_WBUF, -1, false, nullptr, part_off[count], part_len[count]);
+    return true;
+}
+#undef BOUNDARY
+
+// 错误响应：原来只有状态行，没有头部和空行，长连接/流水线下客户端无法判断响应在哪里结束
+bool HttpConn::add_error(int status, const char* form) {
+    add_status_line(status);
+    add_content_length(strlen(form));
+    add_literal("Content-Type:text/html\r\n");
+    end_headers();
+    return add_content(form);
+}
+
+// 分块响应的头部：和普通响应一样，只是用 Transfer-Encoding: chunked 代替 Content-Length
+bool HttpConn::begin_chunked(int status, const HttpText& content_type) {
+    int start = m_write_idx;
+    if (!(add_status_line(status) && add_text(content_type) && add_literal("Transfer-Encoding: chunked\r\n")
+          && end_headers())) return false;
+    push_seg(SEG_WBUF, -1, false, nullptr, start, m_write_idx - start);
+    return true;
+}
+
+// 一块数据："长度(十六进制)\r\n" + 数据 + "\r\n"；长度为 0 的块表示结束，这里直接忽略
+bool HttpConn::add_chunk(const char* data, size_t len) {
+    if (len == 0) return true;
+    int start = m_write_idx;
+    if (!reserve_write(16 + 2)) return false;
+    m_write_idx += http_xtoa(m_write_buf + m_write_idx, len);
+    add_literal("\r\n");
+    push_seg(SEG_WBUF, -1, false, nullptr, start, m_write_idx - start);
+    push_seg(SEG_MEM, -1, false, data, 0, len);
+    start = m_write_idx;
+    if (!add_literal("\r\n")) return false;
+    push_seg(SEG_WBUF, -1, false, nullptr, start, m_write_idx - start);
+    return true;
+}
+
+bool HttpConn::end_chunked() {
+    int start = m_write_idx;
+    if (!add_literal("0\r\n\r\n")) return false;
+    push_seg(SEG_WBUF, -1, false, nullptr, start, m_write_idx - start);
+    return true;
+}
+
+// 文件名里的 HTML 特殊字符转义后追加到 out
+static void append_html(string& out, const char* s) {
+    for (; *s; ++s) {
+        switch (*s) {
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '&': out += "&amp;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += *s; break;
+        }
+    }
+}
+
+// 已上传文件的列表页：页面多长要把目录读完才知道，所以用分块响应，
+// 每攒够 LIST_CHUNK 字节的条目就排成一块，不用先拼出整页再算 Content-Length
+bool HttpConn::add_upload_list(DIR* dir) {
+    static const char head[] = "<html><head><meta charset=\"utf-8\"><title>Uploads</title></head><body><ul>\n";
+    static const char tail[] = "</ul></body></html>\n";
+    if (!begin_chunked(200, http_mime(".html")->header) || !add_chunk(head, sizeof(head) - 1)) return false;
+    string* batch = nullptr;
+    while (struct dirent* d = readdir(dir)) {
+        if (strncmp(d->d_name, "upload_", 7) != 0) continue;
+        if (!batch) {
+            m_chunks.emplace_back();
+            batch = &m_chunks.back();
+        }
+        *batch += "<li><a href=\"/";
+        append_html(*batch, d->d_name);
+        *batch += "\">";
+        append_html(*batch, d->d_name + 7);
+        *batch += "</a></li>\n";
+        if (batch->size() >= LIST_CHUNK) {
+            if (!add_chunk(batch->data(), batch->size())) return false;
+            batch = nullptr;
+        }
+    }
+    if (batch && !add_chunk(batch->data(), batch->size())) return false;
+    return add_chunk(tail, sizeof(tail) - 1) && end_chunked();
 }
 
 bool HttpConn::process_write(HTTP_CODE ret) {
+    // 流水线下写缓冲区里可能已经有前面请求的响应头，本响应从这里开始
+    int start = m_write_idx;
     switch (ret) {
         case INTERNAL_ERROR:
-            add_status_line(500, "Internal Server Error");
-            // 原版这里可能没加 content，直接返回空 body 也是可以的
+            if (!add_error(500, "There was an unusual problem serving the request file.\n")) return false;
             break;
             
         case NO_RESOURCE:
-            add_status_line(404, "Not Found");
+            if (!add_error(404, "The requested file was not found on this server.\n")) return false;
             break;
             
         case FORBIDDEN_REQUEST:
-            add_status_line(403, "Forbidden");
+            if (!add_error(403, "You do not have permission to get file from this server.\n")) return false;
             break;
 
         // ======================================================
@@ -634,7 +1372,7 @@ bool HttpConn::process_write(HTTP_CODE ret) {
         // 对应 do_request 中返回的 GET_REQUEST
         // ======================================================
         case GET_REQUEST:
-            add_status_line(200, "OK");
+            add_status_line(200);
             
             // 1. 如果是 JSON 模式 (我们在 do_request 里标记的)
             if (m_is_json && m_json_string) {
@@ -659,23 +1397,57 @@ bool HttpConn::process_write(HTTP_CODE ret) {
         // ======================================================
         // 处理静态文件 (保持原样)
         // ======================================================
-        case FILE_REQUEST:
-            add_status_line(200, "OK");
-            if (m_file_stat.st_size != 0) {
-                add_headers(m_file_stat.st_size);
-                
-                // 核心差异：文件传输需要两块内存 (头 + 文件)
-                m_iv[0].iov_base = m_write_buf;
-                m_iv[0].iov_len = m_write_idx;
-                m_iv[1].iov_base = m_file_address; 
-                m_iv[1].iov_len = m_file_stat.st_size;
-                m_iv_count = 2;
-                return true;
-            } else {
-                const char* ok_string = "<html><body></body></html>";
-                add_headers(strlen(ok_string));
-                if (!add_content(ok_string)) return false;
+        case FILE_REQUEST: {
+            // 响应头直接用缓存里拼好的，不经过写缓冲区；小文件本体在内存，大文件走 sendfile
+            // fd 由缓存持有 (own_fd = false)，m_file 保证发送期间条目不会被释放
+            // 客户端接受压缩时发预先压缩好的版本 (总在内存里)
+            const FileCache::Entry* f = m_file.get();
+
+            // 客户端缓存仍然有效：只回 304 和校验值，完全不发文件内容
+            if (not_modified()) {
+                add_status_line(304);
+                add_validators(f->etag[f->pick(m_accept_enc)], f->last_modified);
+                if (f->vary) add_literal("Vary: Accept-Encoding\r\n");
+                if (!end_headers()) return false;
+                break;
+            }
+
+            // Range 请求 (比如视频拖动进度条) 只发需要的字节；区间按原始内容计算，不压缩
+            ByteRange ranges[MAX_RANGES];
+            int count = 0;
+            RANGE_STATUS rs = parse_range(f->size, ranges, &count);
+            if (rs == RANGE_OK) return add_range_response(ranges, count);
+            if (rs == RANGE_UNSATISFIABLE) {
+                add_status_line(416);
+                add_literal("Content-Range: bytes */");
+                add_number(f->size);
+                add_literal("\r\n");
+                add_content_length(0);
+                if (!end_headers()) return false;
+                break;
             }
+
+            // 缓存的头部不含 Date / Connection，这两行和空行写进写缓冲区，紧跟在缓存头部后面发
+            FileCache::ENCODING enc = f->pick(m_accept_enc);
+            const string& header = f->header[enc];
+            if (!end_headers()) return false;
+            push_seg(SEG_MEM, -1, false, header.data(), 0, header.size());
+            push_seg(SEG_WBUF, -1, false, nullptr, start, m_write_idx - start);
+            if (enc == FileCache::ENC_IDENTITY && f->fd >= 0) push_seg(SEG_FILE, f->fd, false, nullptr, 0, f->size);
+            else push_seg(SEG_MEM, -1, false, f->body[enc].data(), 0, f->body[enc].size());
+            return true;
+        }
+
+        case LIST_REQUEST: {
+            DIR* dir = opendir(doc_root);
+            if (!dir) {
+                if (!add_error(500, "There was an unusual problem serving the request file.\n")) return false;
+                break;
+            }
+            bool ok = add_upload_list(dir);
+            closedir(dir);
+            return ok;
+        }
             
         default:
             return false;
@@ -683,21 +1455,106 @@ bool HttpConn::process_write(HTTP_CODE ret) {
 
     // 对于非 FILE_REQUEST 的情况 (比如刚才的 JSON，或者错误码)
     // 我们只需要发送 m_write_buf 这一块内存
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
+    push_seg(SEG_WBUF, -1, false, nullptr, start, m_write_idx - start);
     return true;
 }
 
+// 流水线：一次把缓冲区里所有完整的请求都解析掉，响应按顺序排进同一个发送队列，
+// 由一次 sendmsg 合并发出；一批最多 MAX_PIPELINE 个，剩下的等这批发完再处理
+int HttpConn::handle_requests() {
+    m_pipeline_pending = false;
+    int served = 0;
+    while (true) {
+        HTTP_CODE read_ret = process_read();
+        if (read_ret == NO_REQUEST) break;   // 请求还不完整，等更多数据
+        if (!process_write(read_ret)) return -1;
+        ++served;
+        m_keep_alive = m_linger;
+        if (!m_keep_alive) break;            // Connection: close 之后的请求不再处理
+        if (!next_request()) break;
+        if (served >= MAX_PIPELINE || m_write_idx + WRITE_BUFFER_SIZE > WRITE_BUFFER_MAX) {
+            m_pipeline_pending = true;
+            break;
+        }
+    }
+    if (served == 0) {
+        // 请求还不完整但缓冲区已到上限 (请求头或普通请求体过大)：再读也放不下，关闭连接
+        if (!ensure_read_space()) return -1;
+        return EPOLLIN;
+    }
+    return EPOLLOUT;
+}
+
 void HttpConn::process() {
-    HTTP_CODE read_ret = process_read();
-    if (read_ret == NO_REQUEST) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
-        return;
+    int ev = handle_requests();
+    if (ev < 0) defer_close();
+    else rearm(ev);
+}
+
+// worker 里要关连接时不直接 close：连接的定时器挂在所属 loop 的时间轮上，只能由那个 loop 摘下来，
+// 而 fd 一关就可能被别的 loop accept 复用。这里 shutdown 之后把连接交还给 loop，
+// loop 读到 EOF 走正常的关闭路径 (摘定时器、回收连接)
+void HttpConn::defer_close() {
+    delete m_upload;         // 未完成的上传文件在这里删掉，同时 direct_read() 不再成立
+    m_upload = nullptr;
+    m_read_idx = 0;          // 缓冲区里剩下的请求不再处理，read_once 只会读到 EOF
+    shutdown(m_sockfd, SHUT_RDWR);
+    rearm(EPOLLIN);
+}
+
+// 响应没发完算发送阶段；否则看解析状态：请求体解析到一半是收请求体，
+// 缓冲区空着且上一个响应是长连接算空闲，其余 (新连接、请求头没收全) 都是收请求头
+HttpConn::PHASE HttpConn::phase() const {
+    if (m_bytes_to_send > 0) return PHASE_WRITE;
+    if (m_check_state == CHECK_STATE_CONTENT) return PHASE_BODY;
+    if (m_check_state == CHECK_STATE_REQUESTLINE && m_read_idx == 0 && m_keep_alive) return PHASE_IDLE;
+    return PHASE_HEADER;
+}
+
+int64_t HttpConn::deadline(int64_t now) {
+    PHASE p = phase();
+    long long bytes = p == PHASE_WRITE ? m_bytes_sent : m_bytes_received;
+    if (p != m_phase || m_phase_start < 0) {
+        m_phase = p;
+        m_phase_start = m_progress_at = now;
+        m_phase_bytes = m_progress_bytes = bytes;
+    } else if (bytes != m_progress_bytes) {
+        m_progress_at = now;
+        m_progress_bytes = bytes;
+    }
+
+    int timeout, rate;
+    switch (p) {
+        case PHASE_HEADER: timeout = s_timeouts.header; rate = s_timeouts.min_read_rate; break;
+        case PHASE_BODY: timeout = s_timeouts.body; rate = s_timeouts.min_read_rate; break;
+        case PHASE_WRITE: timeout = s_timeouts.write; rate = s_timeouts.min_write_rate; break;
+        default: return m_phase_start + s_timeouts.idle;   // 空闲阶段没有数据进出
     }
-    bool write_ret = process_write(read_ret);
-    if (!write_ret) {
-        close_conn();
+    int64_t expire = m_progress_at + timeout;
+    if (rate > 0) {
+        int64_t by_rate = m_phase_start + timeout + (bytes - m_phase_bytes) * 1000 / rate;
+        if (by_rate < expire) expire = by_rate;
     }
-    modfd(m_epollfd, m_sockfd, EPOLLOUT); 
+    return expire;
+}
+
+const char* HttpConn::phase_name() const {
+    static const char* names[] = { "header", "body", "idle", "write" };
+    return names[m_phase];
+}
+
+// 只看缓冲区开头的原始字节，不改解析状态：流水线里的多个请求、带请求体的请求、
+// 解析到一半的请求、没缓存或需要 sendfile 的大文件都交给线程池
+bool HttpConn::cheap_request() const {
+    if (m_check_state != CHECK_STATE_REQUESTLINE || m_checked_idx != 0 || m_read_idx < 4) return false;
+    const char* buf = m_read_buf;
+    const char* end = buf + m_read_idx;
+    if (memcmp(buf, "GET ", 4) != 0) return false;
+    const char* hdr_end = (const char*)memmem(buf, m_read_idx, "\r\n\r\n", 4);
+    if (!hdr_end || hdr_end + 4 != end) return false;
+    const char* url = buf + 4;
+    const char* url_end = HttpScan::find_space(url, hdr_end);
+    if (url_end == hdr_end || url[0] != '/') return false;
+    if (url_end - url == 1) return FileCache::Instance()->resident("/index.html", sizeof("/index.html") - 1);
+    return FileCache::Instance()->resident(url, url_end - url);
 }
\ No newline at end of file
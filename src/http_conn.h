@@ -5,29 +5,59 @@
 #include <arpa/inet.h>   // sockaddr_in
 #include <sys/stat.h>    // stat
 #include <fcntl.h>       // open
+#include <dirent.h>      // opendir (上传列表页)
 #include <unistd.h>      // close, write
-#include <sys/mman.h>    // mmap
+#include <sys/sendfile.h> // sendfile
 #include <string.h>      // memset, strcpy
+#include <stdint.h>      // int64_t
 #include <string>
 #include <iostream>
 #include <vector>
+#include <deque>
 #include <map>           
+#include <atomic>
 #include <sys/epoll.h>   // epoll_event
 #include "sql_conn_pool.h" // 数据库连接池
+#include "buffer_pool.h"   // 读写缓冲区内存池
+#include "file_cache.h"    // 静态文件缓存
+#include "http_scan.h"     // SIMD 扫描行尾 / 冒号 / 空白
+#include "http_headers.h"  // 请求头名字的编译期完美哈希表
+#include "http_response.h" // 预先拼好的状态行 / Content-Type 行、itoa、Date 缓存
+#include "http_chunked.h"  // Transfer-Encoding: chunked 请求体解码
 
 using namespace std;
 
+extern const char* doc_root;  // 静态资源根目录
+
 // 全局函数声明
 void setnonblocking(int fd);
-void addfd(int epollfd, int fd, bool one_shot);
+void addfd(int epollfd, int fd, bool one_shot, bool set_nonblock = true);
 void removefd(int epollfd, int fd);
 void modfd(int epollfd, int fd, int ev);
 
 class HttpConn {
 public:
     static const int FILENAME_LEN = 200;       
-    static const int READ_BUFFER_SIZE = 1048576;  
-    static const int WRITE_BUFFER_SIZE = 1024; 
+    static const int READ_BUFFER_SIZE = 1048576;  // 读缓冲区上限 (按需从 4KB 开始扩容)
+    static const int READ_BUFFER_INIT = 4096;
+    static const int WRITE_BUFFER_SIZE = 2048;     // 写缓冲区初始大小 (多段 Range 响应的各段头部也放在这里)
+    static const int WRITE_BUFFER_MAX = 65536;     // 流水线响应头累积时最多扩容到这么大
+    static const int MAX_IOV = 32;                    // 一次 sendmsg 最多合并的内存段 (流水线的多个响应一起发)
+    static const int MAX_PIPELINE = 16;               // 一次 process() 最多处理的流水线请求数
+    static const size_t SENDFILE_CHUNK = 256 * 1024;  // 单次 sendfile 的最大字节数
+    static const size_t SEND_BUDGET = 1024 * 1024;    // 一次写事件最多发送的字节，超过就让出给其他连接
+    static const int MAX_RANGES = 8;                  // Range 最多接受的区间数，超过按整个文件返回
+    static const int MAX_PART_HEADER = 8192;          // multipart 里单个 part 头部的上限
+    static const size_t MAX_FORM_FIELD = 4096;        // multipart 普通表单字段最多保留的字节
+    static const size_t SPLICE_CHUNK = 256 * 1024;    // 上传走 splice 时一次 MSG_PEEK 检查的字节数
+    static const long long SPLICE_MIN = 64 * 1024;    // 剩余请求体不到这么多时直接 recv，不值得 splice
+    static const size_t LIST_CHUNK = 4096;            // 上传列表页每攒够这么多字节的条目就排成一块
+    // 各阶段的默认超时 (毫秒) 和最低速率 (字节/秒)，main 里可以按命令行改 s_timeouts
+    static const int HEADER_TIMEOUT = 10000;          // 收请求行和请求头 (新连接的第一个请求也算)
+    static const int BODY_TIMEOUT = 15000;            // 收请求体 (包括上传)
+    static const int IDLE_TIMEOUT = 15000;            // 长连接上一个响应发完后，等下一个请求
+    static const int WRITE_TIMEOUT = 15000;           // 响应没发完，客户端一直不收
+    static const int MIN_RATE = 1024;                 // 收请求 / 发响应的最低平均速率
 
     enum METHOD { GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT, PATCH };
 
@@ -37,6 +67,32 @@ public:
         CHECK_STATE_CONTENT          
     };
 
+    // 非阻塞发送的结果
+    enum SEND_STATUS {
+        SEND_DONE = 0,  // 响应全部发完
+        SEND_AGAIN,     // 内核发送缓冲区满 (EAGAIN)，等 EPOLLOUT
+        SEND_YIELD,     // 本轮预算用完，主动让出，等下一次 EPOLLOUT 续传
+        SEND_ERROR
+    };
+
+    // 连接当前所处的超时阶段
+    enum PHASE {
+        PHASE_HEADER = 0,
+        PHASE_BODY,
+        PHASE_IDLE,
+        PHASE_WRITE
+    };
+
+    // 各阶段超时 (毫秒)；min_*_rate 为 0 表示只看有没有进展，不检查速率
+    struct Timeouts {
+        int header;
+        int body;
+        int idle;
+        int write;
+        int min_read_rate;    // 收请求头 / 请求体，字节/秒
+        int min_write_rate;   // 发响应，字节/秒
+    };
+
     enum LINE_STATUS {
         LINE_OK = 0,  
         LINE_BAD,     
@@ -50,74 +106,211 @@ public:
         NO_RESOURCE,       
         FORBIDDEN_REQUEST, 
         FILE_REQUEST,      
+        LIST_REQUEST,      // 生成的上传文件列表页 (GET /uploads)
         INTERNAL_ERROR,    
         CLOSED_CONNECTION  
     };
 
 public:
-    HttpConn() {}
-    ~HttpConn() {}
+    HttpConn() : m_sockfd(-1), m_loop(nullptr), m_node(0), m_read_idx(0), m_write_idx(0), m_send_head(0),
+                 m_read_buf(nullptr), m_read_cap(0), m_write_buf(nullptr), m_write_cap(0),
+                 m_phase(PHASE_HEADER), m_phase_start(-1), m_progress_at(0), m_phase_bytes(0),
+                 m_progress_bytes(0), m_bytes_received(0), m_bytes_sent(0), m_upload(nullptr) {}
+    ~HttpConn() { release_buffers(); }
 
-    void init(int sockfd, const sockaddr_in& addr);
-    void close_conn();
+    // epollfd: 该连接所属 Sub-Reactor 的 epoll 实例，io_uring 后端为 -1
+    // loop: 所属的 loop，worker 处理完通过 s_rearm_hook 把连接交还给它；为 nullptr 时 worker 直接 EPOLL_CTL_MOD
+    void init(int sockfd, const sockaddr_in& addr, int epollfd, void* loop = nullptr);
+    void close_conn(bool real_close = true);
     void process();
+    // 解析缓冲区里的请求并把响应排进发送队列，返回接下来要等的事件 (EPOLLIN / EPOLLOUT)，-1 表示需要关闭连接
+    // process() 就是它加上重新挂起事件；loop 线程就地处理时自己决定怎么发送
+    int handle_requests();
+    // 缓冲区里正好是一个完整的 GET，目标是内存里已缓存的小文件：处理起来只有几次 memcpy，
+    // loop 线程可以不交给线程池直接处理
+    bool cheap_request() const;
     bool read_once();
-    bool write();
+    int write();                            // 同 write_done() 的返回值，epoll 后端的 loop 线程在 EPOLLOUT 时调用
+
+    // io_uring 后端使用的接口：recv/writev 由 loop 提交到 ring，完成后回调这里推进状态
+    bool read_space(char** buf, int* len); // 读缓冲区剩余空间，满了返回 false
+    void read_done(int n);
+    // 上传的文件内容正由 worker 从 socket 直接 splice 进文件：loop 只等可读，不要 recv 进读缓冲区
+    bool direct_read() const {
+        return m_check_state == CHECK_STATE_CONTENT && m_is_multipart && m_upload && m_upload->direct;
+    }
+    // 队列头部连续的内存段，返回 0 表示头部是文件段或已发完；file_follows 表示后面紧跟文件段
+    int write_iov(struct iovec* iov, int max, bool* file_follows = nullptr);
+    // 1: 还没发完  0: 发完且长连接  -1: 发完需关闭  2: 发完且缓冲区里还有流水线请求，需要再派发 process()
+    int write_done(int n);
+    SEND_STATUS send_some();                // 非阻塞发送 (内存段 sendmsg，文件段 sendfile)，直到 EAGAIN 或预算用完
+
+    // 按当前阶段算出连接的超时时刻 (timer_now() 的毫秒数)，只能由所属 loop 在连接不在 worker 手里时调用
+    // (读写事件处理完、交给 worker 之前，或 worker 交还之后)。阶段变了从 now 重新计时；同一阶段内取
+    // "最后一次有数据进出 + 阶段超时" 和 "阶段开始 + 阶段超时 + 已收发字节 / 最低速率" 中较早的一个：
+    // 卡住不动的和一个字节一个字节挤牙膏的连接都会超时，正常收发的连接不受影响
+    int64_t deadline(int64_t now);
+    const char* phase_name() const;
+    static Timeouts s_timeouts;
+
+    // worker 处理完后通过该钩子把 (fd, EPOLLIN/EPOLLOUT) 交还给所属 loop，由 loop 挂回定时器、重新挂起事件
+    typedef void (*RearmHook)(void* loop, int fd, int ev);
+    static RearmHook s_rearm_hook;
+    void* loop() const { return m_loop; }
 
     // 初始化数据库读取表
     void initmysql_result(SqlConnPool* connPool);
 
 public:
-    static int m_epollfd;
-    static int m_user_count;
+    // 多个 Sub-Reactor 线程与 worker 会同时增减，必须是原子变量
+    static atomic<int> m_user_count;
 
 private:
-    // 【新增】文件上传相关变量
-    char m_boundary[100];      // 存储分界线 (比如: ------WebKitFormBoundary...)
-    bool m_is_multipart;       // 标记本次请求是不是文件上传
-    char m_upload_filename[100]; // 存储上传的文件名 (比如: avatar.jpg)
-    char* m_file_content;      // 指向 POST 请求体中文件数据的起始位置
+    // multipart 流式解析的状态
+    enum MP_STATE {
+        MP_PREAMBLE = 0,  // 第一个分界线之前
+        MP_DELIM,         // 刚过一个分界线，看后面是 "\r\n" (下一个 part) 还是 "--" (结束)
+        MP_HEADERS,       // part 头部 (Content-Disposition 等)
+        MP_DATA,          // part 内容，一直到下一个 "\r\n--boundary"
+        MP_EPILOGUE       // 结束分界线之后，剩下的字节全部丢弃
+    };
+    // 文件上传的冷数据：只有 multipart 请求才从堆上分配，普通连接不占这些字节
+    struct UploadInfo {
+        Horspool delim;          // "\r\n--" + boundary (比如: \r\n------WebKitFormBoundary...)
+        MP_STATE state;
+        long long remaining;     // 请求体里还没处理的字节数
+        int fd;                  // 当前文件 part 写入的文件，-1 表示不是文件
+        bool is_field;           // 当前 part 是普通表单字段 (没有 filename)
+        bool prealloc;           // 当前文件按剩余请求体长度 fallocate 过，写完要截到实际大小
+        bool direct;             // 正在 socket -> 文件 splice，socket 暂时没数据
+        long long part_size;     // 当前 part 已写入的字节数
+        char path[256];          // 当前文件 part 的保存路径
+        char name[64];           // 当前 part 的字段名
+        string value;            // 普通表单字段的值 (最多 MAX_FORM_FIELD 字节)
 
-    // 【新增】专门解析 multipart 协议的函数
-    HTTP_CODE parse_multipart_content(char* text);
+        UploadInfo() : state(MP_PREAMBLE), remaining(0), fd(-1), is_field(false), prealloc(false),
+                       direct(false), part_size(0) {
+            path[0] = name[0] = '\0';
+        }
+        // 连接在上传中途断开/出错：半截文件删掉
+        ~UploadInfo() {
+            if (fd >= 0) {
+                close(fd);
+                unlink(path);
+            }
+        }
+    };
 
-    // 【新增】Cookie 业务相关变量
-    int m_set_cookie;        // 标记是否需要在响应头设置 Set-Cookie
-    bool m_cookie_is_login;
-    
+    // Range 请求里的一个区间 [first, last] (闭区间，已按文件大小换算)
+    struct ByteRange {
+        off_t first;
+        off_t last;
+    };
+    enum RANGE_STATUS {
+        RANGE_NONE = 0,      // 没有 Range / 语法不支持 / If-Range 不匹配：按整个文件返回 200
+        RANGE_OK,            // 返回 206
+        RANGE_UNSATISFIABLE  // 所有区间都越界：返回 416
+    };
+
+    // 响应发送队列里的一段：内存段走 writev/sendmsg，文件段走 sendfile
+    // 每段各自记录发送进度，部分写后下次 EPOLLOUT 从断点续传
+    enum SEG_TYPE {
+        SEG_WBUF = 0,   // m_write_buf 内 [offset, offset+len)
+        SEG_MEM,        // 外部内存 data (比如 JSON 字符串常量)
+        SEG_FILE        // 文件 fd 的 [offset, offset+len)
+    };
+    struct SendSeg {
+        SEG_TYPE type;
+        int fd;
+        bool own_fd;        // 发完/连接关闭时由队列负责 close
+        const char* data;
+        off_t offset;
+        size_t len;         // 剩余字节数
+    };
+
+    // 【新增】multipart 上传：请求体边到边解析，文件内容直接写盘
+    HTTP_CODE parse_multipart();
+    bool open_part(char* headers);
+    bool write_part(const char* data, size_t len);
+    void close_part();
+    int splice_part();
+    bool splice_to_file(size_t len);
+
+    // ---------- 热字段：每次读写事件都会访问，集中放在对象开头 ----------
     int m_sockfd;
-    sockaddr_in m_address;
+    int m_epollfd;       // 所属 Sub-Reactor 的 epoll fd (每个 loop 各自一份)
+    void* m_loop;        // 所属 loop，worker 交还连接时用
+    int m_node;          // 所属 loop 所在的 NUMA 节点，读写缓冲区都从这个节点的内存池借
 
-    char m_read_buf[READ_BUFFER_SIZE];
+    CHECK_STATE m_check_state;
+    METHOD m_method;
     int m_read_idx;
     int m_checked_idx;
     int m_start_line;
-
-    char m_write_buf[WRITE_BUFFER_SIZE];
+    int m_line_end;       // 当前行结尾 (原 \r 的位置，已改成 '\0')
+    int m_colon;          // 当前头部行第一个冒号的位置，-1 表示还没找到
     int m_write_idx;
+    long long m_content_length; // 请求体长度 (multipart 上传不受读缓冲区大小限制，可能超过 2GB)
+    size_t m_bytes_to_send;    // 本次响应剩余待发送字节
+    size_t m_bytes_have_send;  // 本次响应已发送字节
+    size_t m_send_head;        // 发送队列里第一个未发完的段
+    bool m_linger;        
+    bool m_keep_alive;      // 已排队的最后一个响应是否长连接 (m_linger 在解析下一个请求时会被重置)
+    bool m_pipeline_pending;// 本批达到上限，缓冲区里还有没处理的流水线请求
+    char m_end_byte;        // parse_content 补 '\0' 时覆盖掉的字节
+    bool m_is_multipart;    // 标记本次请求是不是文件上传
+    bool m_chunked;         // 请求体是 Transfer-Encoding: chunked (忽略 Content-Length)
+    bool m_is_json;         // 标记本次响应是否为 JSON
+    bool m_cookie_is_login;
+    unsigned char m_accept_enc; // Accept-Encoding 可接受的编码 (1 << FileCache::ENC_xxx)
+    int m_set_cookie;       // 标记是否需要在响应头设置 Set-Cookie
+    vector<SendSeg> m_send_q;  // 响应发送队列 (clear 后保留容量，不会每个请求都 malloc)
 
-    CHECK_STATE m_check_state;
-    METHOD m_method;
+    // ---------- 读写缓冲区：从 BufferPool 按需借用，按 2 倍扩容，连接空闲时归还 ----------
+    char* m_read_buf;
+    size_t m_read_cap;
+    char* m_write_buf;
+    size_t m_write_cap;
 
-    char* m_real_file;    
+    // ---------- 超时阶段：由 deadline() 维护，收发字节数在真正收发数据的地方累加 ----------
+    PHASE m_phase;
+    int64_t m_phase_start;       // 进入当前阶段的时刻，-1 表示新连接还没算过
+    int64_t m_progress_at;       // 当前阶段最近一次有数据进出的时刻
+    long long m_phase_bytes;     // 进入当前阶段时的收发字节计数
+    long long m_progress_bytes;  // 上次 deadline() 时的收发字节计数
+    long long m_bytes_received;  // 连接累计收到的字节 (recv + splice)
+    long long m_bytes_sent;      // 连接累计发出的字节
+
+    // ---------- 指向读缓冲区内部的解析结果 (读缓冲区扩容搬家时需要整体平移) ----------
     char* m_url;          
     char* m_version;      
     char* m_host;         
-    int m_content_length; 
-    bool m_linger;        
+    char* m_string;       
+    char* m_file_content;   // 指向 POST 请求体中文件数据的起始位置
+    char* m_json_string;    // 存储要发送的 JSON 字符串内容
+    char* m_range;          // Range 头的值 (比如 "bytes=0-1023")
+    char* m_if_range;       // If-Range 头的值
+    char* m_if_none_match;  // If-None-Match 头的值
+    char* m_if_modified_since; // If-Modified-Since 头的值
 
-    char* m_file_address; 
-    struct stat m_file_stat;
-    struct iovec m_iv[2];
-    int m_iv_count;
+    // ---------- 冷字段 ----------
+    ChunkedDecoder m_chunk; // chunked 请求体的解码进度
+    UploadInfo* m_upload;
+    FileCache::EntryPtr m_file; // do_request 从缓存取到的静态文件，发送期间一直持有
+    vector<FileCache::EntryPtr> m_files; // 流水线里前面几个已排队响应引用的缓存条目
+    deque<string> m_chunks;             // 生成页面的分块内容，发送队列里的内存段指向这里，发完才清空
+    sockaddr_in m_address;
 
-    char* m_string;       
-    
-    char m_sql_user[100];
-    char m_sql_passwd[100];
+    BufferPool* buffers() const { return BufferPool::Instance(m_node); }
+    bool ensure_read_space();
+    void rebase_read_ptrs(char* old_buf);
+    bool ensure_write_buf();
+    void release_buffers();
 
     // 【核心修复】之前漏掉了这个声明，导致报错
     void init_parse_state(); 
+    void reset_request();
+    bool next_request();
     
     HTTP_CODE process_read();
     bool process_write(HTTP_CODE ret);
@@ -129,19 +322,43 @@ private:
     
     char* get_line() { return m_read_buf + m_start_line; }
     LINE_STATUS parse_line();
-    void unmap();
+    PHASE phase() const;
+    void rearm(int ev);
+    void defer_close();
+    void push_seg(SEG_TYPE type, int fd, bool own_fd, const char* data, off_t offset, size_t len);
+    void advance(size_t n);
+    void clear_send_queue();
+    bool finish_response();
     
-    bool add_response(const char* format, ...);
+    // 响应序列化：全部是往写缓冲区 memcpy，不走 printf
+    bool reserve_write(size_t n);
+    bool add_bytes(const char* data, size_t len);
+    bool add_text(const HttpText& t) { return add_bytes(t.str, t.len); }
+    template<size_t N>
+    bool add_literal(const char (&s)[N]) { return add_bytes(s, N - 1); }
+    bool add_number(unsigned long long v);
     bool add_content(const char* content);
-    bool add_status_line(int status, const char* title);
+    bool add_status_line(int status);
     bool add_headers(int content_length);
     bool add_content_type();
-    bool add_content_length(int content_length);
+    bool add_content_length(size_t content_length);
+    bool add_content_range(off_t first, off_t last, off_t size);
+    bool add_validators(const char* etag, const char* last_modified);
+    bool add_date();
     bool add_linger();
     bool add_blank_line();
+    bool end_headers();
+    bool add_error(int status, const char* form);
+    // 分块响应：长度事先未知的内容边生成边发。头部不带 Content-Length，
+    // 每块的长度行和结尾 \r\n 写在写缓冲区里，数据本身作为内存段引用 (发送完之前必须保持有效)
+    bool begin_chunked(int status, const HttpText& content_type);
+    bool add_chunk(const char* data, size_t len);
+    bool end_chunked();
+    bool add_upload_list(DIR* dir);
+    bool not_modified();
+    RANGE_STATUS parse_range(off_t size, ByteRange* ranges, int* count);
+    bool add_range_response(const ByteRange* ranges, int count);
 
-    bool m_is_json;         // 标记本次响应是否为 JSON
-    char* m_json_string;    // 存储要发送的 JSON 字符串内容
 };
 
 #endif
\ No newline at end of file
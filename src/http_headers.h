@@ -0,0 +1,105 @@
+#ifndef HTTP_HEADERS_H
+#define HTTP_HEADERS_H
+
+#include <string.h>
+#include <strings.h>
+
+// 已知请求头的编号：parse_headers 按编号 switch 分发
+// 新增一个头：在这里加编号，在 kHeaderNames 里加名字，再在 parse_headers 里加一个 case
+enum HEADER_ID {
+    HDR_UNKNOWN = 0,
+    HDR_CONNECTION,
+    HDR_CONTENT_LENGTH,
+    HDR_CONTENT_TYPE,
+    HDR_HOST,
+    HDR_COOKIE,
+    HDR_ACCEPT_ENCODING,
+    HDR_RANGE,
+    HDR_IF_RANGE,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_TRANSFER_ENCODING,
+    HDR_NUM
+};
+
+struct HeaderName {
+    const char* name;
+    int len;
+};
+
+constexpr int header_strlen(const char* s) {
+    int n = 0;
+    while (s[n]) ++n;
+    return n;
+}
+
+#define HEADER_NAME(s) { s, header_strlen(s) }
+constexpr HeaderName kHeaderNames[HDR_NUM] = {
+    HEADER_NAME(""),
+    HEADER_NAME("Connection"),
+    HEADER_NAME("Content-Length"),
+    HEADER_NAME("Content-Type"),
+    HEADER_NAME("Host"),
+    HEADER_NAME("Cookie"),
+    HEADER_NAME("Accept-Encoding"),
+    HEADER_NAME("Range"),
+    HEADER_NAME("If-Range"),
+    HEADER_NAME("If-None-Match"),
+    HEADER_NAME("If-Modified-Since"),
+    HEADER_NAME("Transfer-Encoding"),
+};
+#undef HEADER_NAME
+
+// 大小写无关的哈希：只取长度、首字符、中间字符、末字符 (|0x20 把字母统一成小写)
+// 不用遍历整个名字；命中后再用 strncasecmp 确认一次
+constexpr unsigned header_hash(const char* s, int len, unsigned seed) {
+    unsigned h = seed;
+    h = (h ^ (unsigned)len) * 0x01000193u;
+    h = (h ^ (unsigned)(s[0] | 0x20)) * 0x01000193u;
+    h = (h ^ (unsigned)(s[len / 2] | 0x20)) * 0x01000193u;
+    h = (h ^ (unsigned)(s[len - 1] | 0x20)) * 0x01000193u;
+    return h;
+}
+
+// 编译期生成的完美哈希表：从 1 开始试 seed，直到所有已知头部落在不同的槽里
+struct HeaderTable {
+    static constexpr int BITS = 5;
+    static constexpr int SIZE = 1 << BITS;
+
+    unsigned seed = 0;
+    unsigned char slot[SIZE] = {};
+
+    static constexpr int index(unsigned h) { return (int)(h >> (32 - BITS)); }
+
+    constexpr HeaderTable() {
+        for (unsigned s = 1; s < 100000 && seed == 0; ++s) {
+            bool used[SIZE] = {};
+            bool ok = true;
+            for (int id = 1; id < HDR_NUM && ok; ++id) {
+                int i = index(header_hash(kHeaderNames[id].name, kHeaderNames[id].len, s));
+                if (used[i]) ok = false;
+                used[i] = true;
+            }
+            if (!ok) continue;
+            seed = s;
+            for (int id = 1; id < HDR_NUM; ++id) {
+                slot[index(header_hash(kHeaderNames[id].name, kHeaderNames[id].len, s))] = id;
+            }
+        }
+    }
+};
+
+constexpr HeaderTable kHeaderTable;
+static_assert(kHeaderTable.seed != 0, "no collision-free seed for the header table, enlarge HeaderTable::BITS");
+
+// 头部名字 -> 编号：一次哈希 + 一次比较，未知头部 (User-Agent、Accept 等) 通常在长度比较处就被排除
+inline HEADER_ID lookup_header(const char* name, int len) {
+    if (len <= 0) return HDR_UNKNOWN;
+    int id = kHeaderTable.slot[HeaderTable::index(header_hash(name, len, kHeaderTable.seed))];
+    if (id && kHeaderNames[id].len == len && strncasecmp(kHeaderNames[id].name, name, len) == 0) {
+        return (HEADER_ID)id;
+    }
+    return HDR_UNKNOWN;
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// 响应序列化用的常量表：状态行、Content-Type 行都在编译期拼好，拼响应时只做 memcpy
+// 数字用查表的 itoa 输出，Date 头每个线程每秒只格式化一次；热路径上没有 printf 系列调用
+
+struct HttpText {
+    const char* str;
+    int len;
+};
+
+constexpr int http_strlen(const char* s) {
+    int n = 0;
+    while (s[n]) ++n;
+    return n;
+}
+
+#define HTTP_TEXT(s) { s, http_strlen(s) }
+
+struct HttpStatus {
+    int code;
+    HttpText line;   // 完整状态行，含 \r\n
+};
+
+constexpr HttpStatus kHttpStatus[] = {
+    { 200, HTTP_TEXT("HTTP/1.1 200 OK\r\n") },
+    { 206, HTTP_TEXT("HTTP/1.1 206 Partial Content\r\n") },
+    { 304, HTTP_TEXT("HTTP/1.1 304 Not Modified\r\n") },
+    { 400, HTTP_TEXT("HTTP/1.1 400 Bad Request\r\n") },
+    { 403, HTTP_TEXT("HTTP/1.1 403 Forbidden\r\n") },
+    { 404, HTTP_TEXT("HTTP/1.1 404 Not Found\r\n") },
+    { 416, HTTP_TEXT("HTTP/1.1 416 Range Not Satisfiable\r\n") },
+    { 500, HTTP_TEXT("HTTP/1.1 500 Internal Server Error\r\n") },
+};
+
+// 状态码 -> 状态行；表里没有的状态码按 500 处理
+inline const HttpText& http_status_line(int code) {
+    const int n = sizeof(kHttpStatus) / sizeof(kHttpStatus[0]);
+    for (int i = 0; i < n - 1; ++i) {
+        if (kHttpStatus[i].code == code) return kHttpStatus[i].line;
+    }
+    return kHttpStatus[n - 1].line;
+}
+
+struct HttpMime {
+    const char* suffix;
+    const char* type;
+    HttpText header;   // "Content-Type:xxx\r\n"
+};
+
+#define HTTP_MIME(suffix, type) { suffix, type, HTTP_TEXT("Content-Type:" type "\r\n") }
+// 最后一项是兜底：未知后缀按 html 处理
+constexpr HttpMime kHttpMime[] = {
+    HTTP_MIME(".html", "text/html"),
+    HTTP_MIME(".css",  "text/css"),
+    HTTP_MIME(".js",   "text/javascript"),
+    HTTP_MIME(".jpg",  "image/jpeg"),
+    HTTP_MIME(".jpeg", "image/jpeg"),
+    HTTP_MIME(".png",  "image/png"),
+    HTTP_MIME(".gif",  "image/gif"),
+    HTTP_MIME(".mp4",  "video/mp4"),
+    HTTP_MIME("",      "text/html"),
+};
+constexpr HttpMime kHttpJson = HTTP_MIME("", "application/json;charset=utf-8");
+#undef HTTP_MIME
+#undef HTTP_TEXT
+
+// 按后缀查 MIME 类型，总是返回表里的一项
+inline const HttpMime* http_mime(const char* url) {
+    const int n = sizeof(kHttpMime) / sizeof(kHttpMime[0]);
+    const char* suffix = url ? strrchr(url, '.') : nullptr;
+    if (suffix != nullptr) {
+        for (int i = 0; i < n - 1; ++i) {
+            if (strcasecmp(suffix, kHttpMime[i].suffix) == 0) return &kHttpMime[i];
+        }
+    }
+    return &kHttpMime[n - 1];
+}
+
+// 无符号整数转十进制，一次查表输出两位；out 至少留 20 字节，返回写入的长度 (不写 '\0')
+inline int http_itoa(char* out, unsigned long long v) {
+    static const char kPairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, kPairs + (v % 100) * 2, 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, kPairs + v * 2, 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+    int n = (int)(tmp + sizeof(tmp) - p);
+    memcpy(out, p, n);
+    return n;
+}
+
+// 无符号整数转十六进制 (分块响应的块大小行)，out 至少留 16 字节，返回写入的长度
+inline int http_xtoa(char* out, unsigned long long v) {
+    static const char kHex[] = "0123456789abcdef";
+    char tmp[16];
+    char* p = tmp + sizeof(tmp);
+    do {
+        *--p = kHex[v & 0xf];
+        v >>= 4;
+    } while (v);
+    int n = (int)(tmp + sizeof(tmp) - p);
+    memcpy(out, p, n);
+    return n;
+}
+
+// "Date: Sat, 17 Oct 2026 08:00:00 GMT\r\n"：每个线程缓存一份，秒数变了才重新格式化，不用加锁
+class HttpDate {
+public:
+    static const int LEN = 37;
+
+    static const char* line() {
+        static thread_local time_t s_sec = 0;
+        static thread_local char s_buf[LEN + 1];
+        time_t now = time(nullptr);
+        if (now != s_sec) {
+            struct tm tm;
+            gmtime_r(&now, &tm);
+            strftime(s_buf, sizeof(s_buf), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+            s_sec = now;
+        }
+        return s_buf;
+    }
+};
+
+#endif
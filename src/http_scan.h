@@ -0,0 +1,140 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+// HTTP 请求扫描：一次比较 16/32 个字节，找行尾 (\r \n)、头部冒号、请求行里的空白
+// 启动时按 CPU 能力选实现：AVX2 (32 字节) > SSE2 (16 字节，x86-64 必有) > 逐字节
+// 每个函数都在 [p, end) 内查找 a/b/c 任一字符，找不到返回 end；不会读越过 end 的字节
+class HttpScan {
+public:
+    // 第一个 \r 或 \n
+    static const char* find_eol(const char* p, const char* end) {
+        return impl()(p, end, '\r', '\n', '\n');
+    }
+
+    // 第一个空格或 \t (请求行里的 token 边界)
+    static const char* find_space(const char* p, const char* end) {
+        return impl()(p, end, ' ', '\t', '\t');
+    }
+
+    // 头部行的单遍扫描：同时找出第一个冒号和行尾，冒号在行尾之后 (或没有) 时 *colon = nullptr
+    static const char* find_eol_colon(const char* p, const char* end, const char** colon) {
+        const char* hit = impl()(p, end, '\r', '\n', ':');
+        *colon = nullptr;
+        if (hit < end && *hit == ':') {
+            *colon = hit;
+            hit = find_eol(hit + 1, end);
+        }
+        return hit;
+    }
+
+    // 当前使用的实现，写日志用
+    static const char* name() {
+        FindFn fn = impl();
+#ifdef HTTP_SCAN_X86
+        if (fn == find_avx2) return "avx2";
+        if (fn == find_sse2) return "sse2";
+#endif
+        (void)fn;
+        return "scalar";
+    }
+
+private:
+    typedef const char* (*FindFn)(const char*, const char*, char, char, char);
+
+    static FindFn impl() {
+        static const FindFn fn = pick();
+        return fn;
+    }
+
+    static FindFn pick() {
+#ifdef HTTP_SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return find_avx2;
+        return find_sse2;
+#else
+        return find_scalar;
+#endif
+    }
+
+    static const char* find_scalar(const char* p, const char* end, char a, char b, char c) {
+        for (; p < end; ++p) {
+            if (*p == a || *p == b || *p == c) return p;
+        }
+        return end;
+    }
+
+#ifdef HTTP_SCAN_X86
+    __attribute__((target("sse2")))
+    static const char* find_sse2(const char* p, const char* end, char a, char b, char c) {
+        const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), vc = _mm_set1_epi8(c);
+        for (; end - p >= 16; p += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i*)p);
+            __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)),
+                                     _mm_cmpeq_epi8(x, vc));
+            int mask = _mm_movemask_epi8(m);
+            if (mask) return p + __builtin_ctz(mask);
+        }
+        return find_scalar(p, end, a, b, c);
+    }
+
+    __attribute__((target("avx2")))
+    static const char* find_avx2(const char* p, const char* end, char a, char b, char c) {
+        const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b), vc = _mm256_set1_epi8(c);
+        for (; end - p >= 32; p += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)p);
+            __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb)),
+                                        _mm256_cmpeq_epi8(x, vc));
+            unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+            if (mask) return p + __builtin_ctz(mask);
+        }
+        return find_sse2(p, end, a, b, c);
+    }
+#endif
+};
+
+// Boyer-Moore-Horspool 子串查找，用于在上传数据里找 multipart 分界线
+// 分界线通常有 40~70 字节，失配时按窗口末字节查表跳过，平均每步前进接近整个模式串长度
+class Horspool {
+public:
+    static const int MAX_LEN = 128;
+
+    Horspool() : m_len(0) {}
+
+    // 模式串超过 MAX_LEN 返回 false
+    bool init(const char* pat, int len) {
+        if (len <= 0 || len > MAX_LEN) return false;
+        memcpy(m_pat, pat, len);
+        m_len = len;
+        for (int i = 0; i < 256; ++i) m_skip[i] = (unsigned char)len;
+        for (int i = 0; i < len - 1; ++i) m_skip[(unsigned char)pat[i]] = (unsigned char)(len - 1 - i);
+        return true;
+    }
+
+    const char* pattern() const { return m_pat; }
+    int size() const { return m_len; }
+
+    // 在 [p, end) 里找第一次完整出现的位置，找不到返回 end
+    const char* find(const char* p, const char* end) const {
+        const unsigned char last = (unsigned char)m_pat[m_len - 1];
+        while (end - p >= m_len) {
+            unsigned char c = (unsigned char)p[m_len - 1];
+            if (c == last && memcmp(p, m_pat, m_len - 1) == 0) return p;
+            p += m_skip[c];
+        }
+        return end;
+    }
+
+private:
+    char m_pat[MAX_LEN];
+    int m_len;
+    unsigned char m_skip[256];
+};
+
+#endif
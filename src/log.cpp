@@ -1,149 +1,524 @@
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <chrono>
 #include "log.h"
-#include <pthread.h> // 【新增】必须加上这个头文件，否则 pthread_create 会报错
 
 using namespace std;
 
+const int Log::FLUSH_INTERVAL_MS;       // chrono::milliseconds 按引用接收，C++14 下需要类外定义
+
+static int64_t clock_ns(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 一个线程的日志暂存：所属线程只推进 head，写线程只推进 tail，都是只增不减的字节计数
+// head / tail 用填充隔开，避免两个线程来回抢同一个 cache line
+struct Log::Stage
+{
+    Stage(int line_size, bool async)
+        : ring(async ? new char[STAGE_SIZE] : nullptr), line(new char[line_size]), line_size(line_size),
+          head(0), tail(0), dropped(0), closed(false), sec(-1), date_len(0) {}
+
+    unique_ptr<char[]> ring;
+    unique_ptr<char[]> line;            // 格式化一行用的缓冲区
+    int line_size;
+    atomic<size_t> head;
+    char pad0[64];
+    atomic<size_t> tail;
+    char pad1[64];
+    atomic<size_t> dropped;             // 环满丢掉的行数，由写线程补一行提示
+    atomic<bool> closed;                // 所属线程已退出，写线程取空后回收
+
+    // 时间戳缓存：同一秒内的日志共用 "YYYY-MM-DD HH:MM:SS." 前缀，只补微秒
+    time_t sec;
+    struct tm tm;
+    char date[32];
+    int date_len;
+
+    int stamp(const struct timeval &now, const char *tag)
+    {
+        if (now.tv_sec != sec)
+        {
+            sec = now.tv_sec;
+            localtime_r(&sec, &tm);
+            date_len = snprintf(date, sizeof(date), "%d-%02d-%02d %02d:%02d:%02d.",
+                                tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        }
+        char *p = line.get();
+        memcpy(p, date, date_len);
+        p += date_len;
+        long usec = now.tv_usec;
+        for (int i = 5; i >= 0; --i, usec /= 10) p[i] = '0' + usec % 10;
+        p += 6;
+        *p++ = ' ';
+        size_t tag_len = strlen(tag);
+        memcpy(p, tag, tag_len);
+        p += tag_len;
+        *p++ = ' ';
+        return p - line.get();
+    }
+};
+
+// 线程退出时把自己的暂存环标记为关闭，环本身由写线程取空后回收
+struct Log::StageRef
+{
+    Stage *st = nullptr;
+    ~StageRef()
+    {
+        if (st) st->closed.store(true, memory_order_release);
+    }
+};
+
 Log::Log()
 {
     m_count = 0;
     m_is_async = false;
+    m_binary = false;
+    m_sites_written = 0;
+    m_tsc0 = 0;
+    m_mono0 = 0;
+    m_ticks_per_ns = 1.0;
+    m_fd = -1;
+    m_kick = false;
+    m_stop = false;
+    m_flush_req = 0;
+    m_flush_done = 0;
 }
 
 Log::~Log()
 {
-    if (m_fp != NULL)
+    if (m_writer.joinable())
     {
-        fclose(m_fp);
+        {
+            lock_guard<mutex> locker(m_wake_mtx);
+            m_stop = true;
+        }
+        m_wake_cv.notify_one();
+        m_writer.join();
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
     }
 }
 
-bool Log::init(const char *file_name, int close_log, int log_buf_size, int split_lines, int max_queue_size)
+bool Log::init(const char *file_name, int close_log, int log_buf_size, int split_lines, int max_queue_size, bool binary)
 {
-    if (max_queue_size >= 1)
+    m_close_log = close_log;
+    m_binary = binary;
+    if (m_binary)
     {
-        m_is_async = true;
-        m_log_queue = new BlockQueue<string>(max_queue_size);
-        
-        pthread_t tid;
-        pthread_create(&tid, NULL, flush_log_thread, NULL);
+        // 先粗测一次 TSC 频率，之后写线程按越来越长的跨度修正
+        m_tsc0 = LogBin::tsc();
+        m_mono0 = clock_ns(CLOCK_MONOTONIC);
+        struct timespec ts = {0, 10 * 1000 * 1000};
+        nanosleep(&ts, NULL);
+        m_ticks_per_ns = (double)(LogBin::tsc() - m_tsc0) / (clock_ns(CLOCK_MONOTONIC) - m_mono0);
     }
-    
-    m_close_log = close_log;
     m_log_buf_size = log_buf_size;
-    m_buf = new char[m_log_buf_size];
-    memset(m_buf, '\0', m_log_buf_size);
     m_split_lines = split_lines;
 
     time_t t = time(NULL);
-    struct tm *sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
 
     const char *p = strrchr(file_name, '/');
-    char log_full_name[256] = {0};
-
     if (p == NULL)
     {
-        snprintf(log_full_name, 255, "%d_%02d_%02d_%s", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, file_name);
+        dir_name[0] = '\0';
+        snprintf(log_name, sizeof(log_name), "%s", file_name);
     }
     else
     {
-        strcpy(log_name, p + 1);
-        strncpy(dir_name, file_name, p - file_name + 1);
-        snprintf(log_full_name, 255, "%s%d_%02d_%02d_%s", dir_name, my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, log_name);
+        snprintf(log_name, sizeof(log_name), "%s", p + 1);
+        snprintf(dir_name, sizeof(dir_name), "%.*s", (int)(p - file_name + 1), file_name);
     }
 
     m_today = my_tm.tm_mday;
-    m_fp = fopen(log_full_name, "a");
-    if (m_fp == NULL)
+    if (!open_file(my_tm, 0))
     {
         return false;
     }
+
+    if (max_queue_size >= 1 || m_binary)
+    {
+        m_is_async = true;
+        m_writer = thread(&Log::writer_loop, this);
+    }
     return true;
 }
 
+// 日期文件名："目录/2024_01_31_ServerLog"，按行数切出来的后续文件再带 ".1"、".2"...
+bool Log::open_file(const struct tm &tm, long long part)
+{
+    char path[320];     // dir_name + log_name 各 128，再加日期和编号
+    if (part == 0)
+        snprintf(path, sizeof(path), "%s%d_%02d_%02d_%s", dir_name, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, log_name);
+    else
+        snprintf(path, sizeof(path), "%s%d_%02d_%02d_%s.%lld", dir_name, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, log_name, part);
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+    m_fd = fd;
+    // 二进制文件每次打开先写 HEADER，站点表随后由写线程整份重写一遍，每个文件都能单独解码
+    if (m_binary)
+    {
+        char rec[sizeof(LogRecord) + LogBin::MAGIC_LEN];
+        LogRecord head = {LogBin::HEADER, (uint32_t)sizeof(rec), LogBin::tsc()};
+        memcpy(rec, &head, sizeof(head));
+        memcpy(rec + sizeof(head), LogBin::magic(), LogBin::MAGIC_LEN);
+        ssize_t ret = ::write(m_fd, rec, sizeof(rec));
+        (void)ret;
+        m_sites_written = 0;
+    }
+    return true;
+}
+
+// SITE 记录在登记时就编码好，写线程按需整条写出
+uint32_t Log::add_site(int level, const char *format, const char *types)
+{
+    size_t nargs = strlen(types);
+    size_t fmt_len = strlen(format);
+    string rec(sizeof(LogRecord) + 6 + nargs + fmt_len, '\0');
+    char *p = &rec[0] + sizeof(LogRecord);
+    lock_guard<mutex> locker(m_mutex);
+    uint32_t id = LogBin::FIRST_SITE + (uint32_t)m_sites.size();
+    LogRecord head = {LogBin::SITE, (uint32_t)rec.size(), 0};
+    memcpy(&rec[0], &head, sizeof(head));
+    memcpy(p, &id, 4);
+    p[4] = (char)level;
+    p[5] = (char)nargs;
+    memcpy(p + 6, types, nargs);
+    memcpy(p + 6 + nargs, format, fmt_len);
+    m_sites.push_back(std::move(rec));
+    return id;
+}
+
+void Log::commit(const char *rec, size_t len)
+{
+    append(stage(), rec, len);
+}
+
+// 当前线程的暂存，第一次写日志时创建并登记 (每个线程只拿一次锁)
+Log::Stage *Log::stage()
+{
+    static thread_local StageRef ref;
+    if (!ref.st)
+    {
+        Stage *st = new Stage(m_log_buf_size, m_is_async);
+        lock_guard<mutex> locker(m_mutex);
+        m_stages.emplace_back(st);
+        ref.st = st;
+    }
+    return ref.st;
+}
+
 void Log::write_log(int level, const char *format, ...)
 {
+    // 二进制模式下直接调用 write_log 的 (格式串不是字面量)：在这里格式化，按 TEXT 记录写
+    if (m_binary)
+    {
+        Stage *st = stage();
+        int n = sizeof(LogRecord) + 1;
+        va_list valst;
+        va_start(valst, format);
+        int m = vsnprintf(st->line.get() + n, st->line_size - n, format, valst);
+        va_end(valst);
+        if (m < 0) m = 0;
+        if (m > st->line_size - n - 1) m = st->line_size - n - 1;
+        LogRecord head = {LogBin::TEXT, (uint32_t)(n + m), LogBin::tsc()};
+        memcpy(st->line.get(), &head, sizeof(head));
+        st->line[n - 1] = (char)level;
+        append(st, st->line.get(), n + m);
+        return;
+    }
+
     struct timeval now = {0, 0};
     gettimeofday(&now, NULL);
-    time_t t = now.tv_sec;
-    struct tm *sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
-    char s[16] = {0};
-    
-    switch (level)
-    {
-    case 0: strcpy(s, "[debug]:"); break;
-    case 1: strcpy(s, "[info]:"); break;
-    case 2: strcpy(s, "[warn]:"); break;
-    case 3: strcpy(s, "[error]:"); break;
-    default: strcpy(s, "[info]:"); break;
-    }
-    
-    m_mutex.lock();
+    Stage *st = stage();
+
+    int n = st->stamp(now, LogBin::level_tag(level));
+    va_list valst;
+    va_start(valst, format);
+    int m = vsnprintf(st->line.get() + n, st->line_size - n - 1, format, valst);
+    va_end(valst);
+    if (m < 0) m = 0;
+    if (m > st->line_size - n - 2) m = st->line_size - n - 2;   // 超长的行截断
+    st->line[n + m] = '\n';
+
+    if (m_is_async)
+    {
+        append(st, st->line.get(), n + m + 1);
+        return;
+    }
+
+    // 同步模式：在调用线程里直接写，按日期 / 行数切分也在这里做
+    lock_guard<mutex> locker(m_mutex);
+    if (m_today != st->tm.tm_mday)
+    {
+        m_today = st->tm.tm_mday;
+        m_count = 0;
+        open_file(st->tm, 0);
+    }
+    else if (m_split_lines > 0 && m_count > 0 && m_count % m_split_lines == 0)
+    {
+        open_file(st->tm, m_count / m_split_lines);
+    }
     m_count++;
+    ssize_t ret = ::write(m_fd, st->line.get(), n + m + 1);
+    (void)ret;
+}
+
+// 追加到本线程的暂存环：只有所属线程写 head，不需要锁
+// 环满说明写线程跟不上 (磁盘太慢或日志太多)：丢掉这一行并计数，不让业务线程等磁盘
+void Log::append(Stage *st, const char *line, size_t len)
+{
+    size_t head = st->head.load(memory_order_relaxed);
+    size_t used = head - st->tail.load(memory_order_acquire);
+    if (STAGE_SIZE - used < len)
+    {
+        st->dropped.fetch_add(1, memory_order_relaxed);
+        m_kick.store(true, memory_order_relaxed);
+        m_wake_cv.notify_one();
+        return;
+    }
+    size_t off = head & (STAGE_SIZE - 1);
+    size_t first = min(len, STAGE_SIZE - off);
+    memcpy(st->ring.get() + off, line, first);
+    memcpy(st->ring.get(), line + first, len - first);
+    st->head.store(head + len, memory_order_release);
+    // 刚越过半满时叫一次写线程，其余时候等它定时来取
+    if (used < STAGE_SIZE / 2 && used + len >= STAGE_SIZE / 2)
+    {
+        m_kick.store(true, memory_order_relaxed);
+        m_wake_cv.notify_one();
+    }
+}
+
+void Log::flush(void)
+{
+    if (!m_is_async)
+    {
+        return;     // 同步模式直接 write，没有缓冲
+    }
+    unique_lock<mutex> locker(m_wake_mtx);
+    unsigned long ticket = ++m_flush_req;
+    m_wake_cv.notify_one();
+    m_flushed_cv.wait(locker, [&] { return m_flush_done >= ticket || m_stop; });
+}
 
-    if (m_today != my_tm.tm_mday || m_count % m_split_lines == 0)
+void Log::writer_loop()
+{
+    unique_lock<mutex> locker(m_wake_mtx);
+    while (true)
     {
-        char new_log[256] = {0};
-        fflush(m_fp);
-        fclose(m_fp);
-        char tail[16] = {0};
-        
-        snprintf(tail, 16, "%d_%02d_%02d_", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday);
-       
+        m_wake_cv.wait_for(locker, chrono::milliseconds(FLUSH_INTERVAL_MS), [this] {
+            return m_stop || m_flush_req != m_flush_done || m_kick.load(memory_order_relaxed);
+        });
+        bool stop = m_stop;
+        unsigned long ticket = m_flush_req;
+        m_kick.store(false, memory_order_relaxed);
+        locker.unlock();
+        drain();
+        locker.lock();
+        m_flush_done = ticket;
+        m_flushed_cv.notify_all();
+        if (stop)
+        {
+            return;
+        }
+    }
+}
+
+// 把所有暂存环里已经提交的内容写进文件，再把 tail 推进过去还给各线程
+// 一个环最多两段 (绕回)，多个线程的内容合成一次 writev；同一批里按线程分组，各线程内部保持顺序
+void Log::drain()
+{
+    vector<Stage *> stages;
+    {
+        lock_guard<mutex> locker(m_mutex);
+        for (auto &st : m_stages) stages.push_back(st.get());
+    }
+
+    vector<struct iovec> iov;
+    vector<size_t> heads(stages.size());
+    string notes;       // 丢行提示，iov 指向它，写完之前不能再改
+    notes.reserve(128 * stages.size());
+    vector<pair<size_t, size_t>> note_pos;
+    string prelude;     // 二进制模式的 CALIBRATE + SITE 记录
+    long long lines = 0;    // 文本模式是行数，二进制模式是记录数
+    for (size_t i = 0; i < stages.size(); ++i)
+    {
+        Stage *st = stages[i];
+        size_t tail = st->tail.load(memory_order_relaxed);
+        size_t head = st->head.load(memory_order_acquire);
+        heads[i] = head;
+        size_t dropped = st->dropped.exchange(0, memory_order_relaxed);
+        if (dropped > 0 && m_binary)
+        {
+            char note[sizeof(LogRecord) + 8];
+            LogRecord rec = {LogBin::DROPPED, (uint32_t)sizeof(note), LogBin::tsc()};
+            uint64_t cnt = dropped;
+            memcpy(note, &rec, sizeof(rec));
+            memcpy(note + sizeof(rec), &cnt, 8);
+            note_pos.emplace_back(notes.size(), sizeof(note));
+            notes.append(note, sizeof(note));
+        }
+        else if (dropped > 0)
+        {
+            char note[128];
+            int len = snprintf(note, sizeof(note), "[warn]: log stage full, %zu lines dropped\n", dropped);
+            note_pos.emplace_back(notes.size(), len);
+            notes.append(note, len);
+        }
+        if (head == tail) continue;
+        if (m_binary && m_split_lines > 0) lines += count_records(st, tail, head);
+        size_t off = tail & (STAGE_SIZE - 1);
+        size_t len = head - tail;
+        size_t first = min(len, STAGE_SIZE - off);
+        iov.push_back({st->ring.get() + off, first});
+        if (len > first) iov.push_back({st->ring.get(), len - first});
+    }
+    for (auto &np : note_pos) iov.push_back({&notes[np.first], np.second});
+
+    if (!iov.empty())
+    {
+        if (!m_binary && m_split_lines > 0)
+        {
+            for (auto &v : iov)
+            {
+                const char *p = (const char *)v.iov_base, *end = p + v.iov_len;
+                while ((p = (const char *)memchr(p, '\n', end - p)) != nullptr) { ++lines; ++p; }
+            }
+        }
+
+        // 切分文件只在这里做：日期变了换新的一天的文件，行数超过阈值换下一个编号 (以批为单位，略超一点)
+        time_t t = time(NULL);
+        struct tm my_tm;
+        localtime_r(&t, &my_tm);
         if (m_today != my_tm.tm_mday)
         {
-            snprintf(new_log, 255, "%s%s%s", dir_name, tail, log_name);
             m_today = my_tm.tm_mday;
             m_count = 0;
+            open_file(my_tm, 0);
         }
-        else
+        else if (m_split_lines > 0 && m_count / m_split_lines != (m_count + lines) / m_split_lines)
         {
-            snprintf(new_log, 255, "%s%s%s.%lld", dir_name, tail, log_name, m_count / m_split_lines);
+            open_file(my_tm, (m_count + lines) / m_split_lines);
         }
-        m_fp = fopen(new_log, "a");
-    }
- 
-    m_mutex.unlock();
+        m_count += lines;
 
-    va_list valst;
-    va_start(valst, format);
-
-    string log_str;
-    m_mutex.lock();
+        // 二进制模式：每批前面带一条 CALIBRATE，再补上这个文件还没写过的 SITE 记录
+        // 站点表在读完各环的 head 之后才取，环里用到的站点一定已经登记
+        if (m_binary)
+        {
+            calibrate(prelude);
+            lock_guard<mutex> locker(m_mutex);
+            for (; m_sites_written < m_sites.size(); ++m_sites_written) prelude += m_sites[m_sites_written];
+        }
+        if (!prelude.empty()) iov.insert(iov.begin(), {&prelude[0], prelude.size()});
 
-    int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ",
-                     my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
-                     my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
-    
-    int m = vsnprintf(m_buf + n, m_log_buf_size - 1, format, valst);
-    m_buf[n + m] = '\n';
-    m_buf[n + m + 1] = '\0';
-    log_str = m_buf;
+        for (size_t i = 0; i < iov.size(); i += IOV_MAX)
+        {
+            write_out(&iov[i], (int)min(iov.size() - i, (size_t)IOV_MAX));
+        }
+    }
 
-    m_mutex.unlock();
+    for (size_t i = 0; i < stages.size(); ++i)
+    {
+        stages[i]->tail.store(heads[i], memory_order_release);
+    }
 
-    if (m_is_async && !m_log_queue->full())
+    // 回收已退出线程的暂存环 (取空之后)
+    lock_guard<mutex> locker(m_mutex);
+    for (size_t i = 0; i < m_stages.size();)
     {
-        m_log_queue->push(log_str);
+        Stage *st = m_stages[i].get();
+        if (st->closed.load(memory_order_acquire) &&
+            st->head.load(memory_order_acquire) == st->tail.load(memory_order_relaxed))
+        {
+            m_stages[i] = std::move(m_stages.back());
+            m_stages.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
     }
-    else
+}
+
+// writev 可能只写了一部分 (信号、磁盘满)，接着写剩下的
+void Log::write_out(const struct iovec *iov, int cnt)
+{
+    vector<struct iovec> rest(iov, iov + cnt);
+    size_t idx = 0;
+    while (idx < rest.size())
     {
-        m_mutex.lock();
-        fputs(log_str.c_str(), m_fp);
-        m_mutex.unlock();
+        ssize_t n = writev(m_fd, &rest[idx], (int)(rest.size() - idx));
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return;
+        }
+        while (idx < rest.size() && (size_t)n >= rest[idx].iov_len)
+        {
+            n -= rest[idx].iov_len;
+            ++idx;
+        }
+        if (idx < rest.size())
+        {
+            rest[idx].iov_base = (char *)rest[idx].iov_base + n;
+            rest[idx].iov_len -= n;
+        }
     }
+}
 
-    va_end(valst);
+// 数一段暂存内容里有几条二进制记录 (切分文件用)；记录头可能跨过环尾，逐字节取
+long long Log::count_records(const Stage *st, size_t tail, size_t head)
+{
+    long long n = 0;
+    const char *ring = st->ring.get();
+    for (size_t pos = tail; pos < head; ++n)
+    {
+        char buf[sizeof(LogRecord)];
+        for (size_t i = 0; i < sizeof(buf); ++i) buf[i] = ring[(pos + i) & (STAGE_SIZE - 1)];
+        LogRecord rec;
+        memcpy(&rec, buf, sizeof(rec));
+        pos += rec.size;
+    }
+    return n;
 }
 
-void Log::flush(void)
+// 记下此刻 TSC 与墙上时间的对应，解码器据此把每条记录的 TSC 换算成时间；频率按 init 以来的跨度估算
+void Log::calibrate(string &out)
 {
-    m_mutex.lock();
-    fflush(m_fp);
-    m_mutex.unlock();
-}
\ No newline at end of file
+    uint64_t tsc = LogBin::tsc();
+    int64_t mono = clock_ns(CLOCK_MONOTONIC);
+    int64_t real = clock_ns(CLOCK_REALTIME);
+    if (mono - m_mono0 > 1000000000LL)
+    {
+        m_ticks_per_ns = (double)(tsc - m_tsc0) / (mono - m_mono0);
+    }
+    char rec[sizeof(LogRecord) + 16];
+    LogRecord head = {LogBin::CALIBRATE, (uint32_t)sizeof(rec), tsc};
+    memcpy(rec, &head, sizeof(head));
+    memcpy(rec + sizeof(head), &real, 8);
+    memcpy(rec + sizeof(head) + 8, &m_ticks_per_ns, 8);
+    out.append(rec, sizeof(rec));
+}
@@ -4,73 +4,146 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <condition_variable>
 #include <sys/time.h>
 #include <string.h>
-#include <stdarg.h>           
+#include <stdarg.h>
 #include <assert.h>
-#include <sys/stat.h>         
-#include "block_queue.h"
+#include <sys/stat.h>
+#include "log_binary.h"
 
 using namespace std;
 
+// 异步日志 (muduo 式双缓冲)：
+// 每个线程第一次写日志时分到一个自己的暂存环 (单生产者单消费者，无锁)，格式化好的一行直接追加进去，
+// 时间戳前缀每个线程每秒只格式化一次；后台写线程定期 (或某个环超过半满时) 把所有环里攒下的内容
+// 用 writev 一批写进文件，写文件的同时各线程继续往环的空闲部分追加
+// 调用方不拿锁、不 fflush；按日期 / 行数切分文件只在写线程里做
+// 二进制模式 (init 的 binary 参数) 下调用点只往环里记 站点 id + TSC + 参数原始字节 (格式见 log_binary.h)，
+// 不格式化时间和文本，由 tools/log_decoder 离线还原成同样格式的文本
 class Log
 {
 public:
+    static const size_t STAGE_SIZE = 256 * 1024;   // 每个线程暂存环的大小 (2 的幂)，写满时新的日志行丢弃并计数
+    static const int FLUSH_INTERVAL_MS = 1000;     // 写线程最长隔多久写一次文件
+
     static Log *Instance()
     {
         static Log instance;
         return &instance;
     }
 
-    static void *flush_log_thread(void *args)
+    // max_queue_size >= 1 开启异步写 (每个线程一个 STAGE_SIZE 的暂存环)，否则在调用线程里直接写文件
+    // log_buf_size 是单行日志的最大长度；binary 写二进制日志 (总是异步)，split_lines 按记录条数算
+    bool init(const char *file_name, int close_log, int log_buf_size = 8192, int split_lines = 5000000, int max_queue_size = 0,
+              bool binary = false);
+
+    void write_log(int level, const char *format, ...);
+
+    bool is_binary() const { return m_binary; }
+
+    // 参数类型列表，只在 decltype 里用，不求值参数
+    template <class... A>
+    struct ArgTypes {};
+    template <class... A>
+    static ArgTypes<typename decay<A>::type...> arg_types(int, const A &...);
+
+    // 登记一个调用点 (每个调用点只执行一次，见 LOG_BASE)，返回站点 id；format 必须是字面量
+    template <class... A>
+    uint32_t register_site(int level, const char *format, ArgTypes<A...>)
     {
-        Log::Instance()->async_write_log();
-        return nullptr;
+        static const char types[] = {LogBin::type_code<A>()..., 0};
+        return add_site(level, format, types);
     }
 
-    bool init(const char *file_name, int close_log, int log_buf_size = 8192, int split_lines = 5000000, int max_queue_size = 0);
-
-    void write_log(int level, const char *format, ...);
+    // 二进制模式的热路径：在栈上拼好一条记录，整条追加进本线程的暂存环
+    template <class... A>
+    void write_bin(uint32_t site, const A &... args)
+    {
+        char rec[LogBin::MAX_RECORD];
+        char *p = rec + sizeof(LogRecord), *end = rec + sizeof(rec);
+        int expand[] = {0, (LogBin::put(p, end, args), 0)...};
+        (void)expand;
+        (void)end;
+        LogRecord head = {site, (uint32_t)(p - rec), LogBin::tsc()};
+        memcpy(rec, &head, sizeof(head));
+        commit(rec, p - rec);
+    }
 
+    // 等写线程把目前暂存的日志全部写进文件再返回 (退出前、排查问题时用)，不要在热路径上调用
     void flush(void);
 
     // 【新增】公开获取关闭状态的接口，给宏使用
     int get_close_log() { return m_close_log; }
 
 private:
+    struct Stage;       // 一个线程的暂存环 + 行缓冲 + 时间戳缓存，定义在 log.cpp
+    struct StageRef;
+
     Log();
     virtual ~Log();
-    
-    void *async_write_log()
-    {
-        string single_log;
-        while (m_log_queue->pop(single_log))
-        {
-            lock_guard<mutex> locker(m_mutex);
-            fputs(single_log.c_str(), m_fp);
-        }
-        return nullptr;
-    }
+
+    Stage *stage();
+    uint32_t add_site(int level, const char *format, const char *types);
+    void commit(const char *rec, size_t len);
+    void append(Stage *st, const char *line, size_t len);
+    void writer_loop();
+    void drain();
+    void write_out(const struct iovec *iov, int cnt);
+    bool open_file(const struct tm &tm, long long part);
+    long long count_records(const Stage *st, size_t tail, size_t head);
+    void calibrate(string &out);
 
 private:
-    char dir_name[128]; 
-    char log_name[128]; 
-    int m_split_lines;  
-    int m_log_buf_size; 
-    long long m_count;  
-    int m_today;        
-    FILE *m_fp;         
-    char *m_buf;        
-    BlockQueue<string> *m_log_queue; 
-    bool m_is_async;    
-    mutex m_mutex;
-    int m_close_log; 
+    char dir_name[128];
+    char log_name[128];
+    int m_split_lines;
+    int m_log_buf_size;
+    long long m_count;      // 当前文件已写的行数
+    int m_today;
+    int m_fd;
+    bool m_is_async;
+    bool m_binary;
+    int m_close_log;
+
+    mutex m_mutex;                      // 保护 m_stages (登记新线程、回收已退出线程的环)；同步模式下还保护文件
+    vector<unique_ptr<Stage>> m_stages;
+    vector<string> m_sites;             // 二进制模式：各调用点编码好的 SITE 记录，下标 = id - FIRST_SITE (受 m_mutex 保护)
+    size_t m_sites_written;             // 当前文件里已经写过的 SITE 记录数 (只有写线程访问)
+
+    // TSC 和墙上时间的对应关系：init 时记一个起点，写线程每批按起点到现在的跨度重新估算频率
+    uint64_t m_tsc0;
+    int64_t m_mono0;
+    double m_ticks_per_ns;
+
+    thread m_writer;
+    mutex m_wake_mtx;
+    condition_variable m_wake_cv;       // 叫醒写线程
+    condition_variable m_flushed_cv;    // 写线程写完一批，通知 flush() 的调用者
+    atomic<bool> m_kick;                // 有环超过半满，写线程不用等到定时
+    bool m_stop;                        // 以下三个受 m_wake_mtx 保护
+    unsigned long m_flush_req;
+    unsigned long m_flush_done;
 };
 
 // 【修复】宏定义：现在通过 get_close_log() 获取状态，而不是直接访问私有变量
-#define LOG_DEBUG(format, ...) if(0 == Log::Instance()->get_close_log()) {Log::Instance()->write_log(0, format, ##__VA_ARGS__); Log::Instance()->flush();}
-#define LOG_INFO(format, ...) if(0 == Log::Instance()->get_close_log()) {Log::Instance()->write_log(1, format, ##__VA_ARGS__); Log::Instance()->flush();}
-#define LOG_WARN(format, ...) if(0 == Log::Instance()->get_close_log()) {Log::Instance()->write_log(2, format, ##__VA_ARGS__); Log::Instance()->flush();}
-#define LOG_ERROR(format, ...) if(0 == Log::Instance()->get_close_log()) {Log::Instance()->write_log(3, format, ##__VA_ARGS__); Log::Instance()->flush();}
+// 写日志只是追加进本线程的暂存环，不再每行 flush
+// 二进制模式下每个调用点用一个函数内 static 登记一次格式串，之后只剩一次 guard 检查
+#define LOG_BASE(level, format, ...) \
+    if(0 == Log::Instance()->get_close_log()) { \
+        if (Log::Instance()->is_binary()) { \
+            static const uint32_t log_site_ = Log::Instance()->register_site(level, format, decltype(Log::arg_types(0, ##__VA_ARGS__))()); \
+            Log::Instance()->write_bin(log_site_, ##__VA_ARGS__); \
+        } else { \
+            Log::Instance()->write_log(level, format, ##__VA_ARGS__); \
+        } \
+    }
+#define LOG_DEBUG(format, ...) LOG_BASE(0, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_BASE(1, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_BASE(2, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_BASE(3, format, ##__VA_ARGS__)
 
-#endif
\ No newline at end of file
+#endif
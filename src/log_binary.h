@@ -0,0 +1,139 @@
+#ifndef LOG_BINARY_H
+#define LOG_BINARY_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// 二进制日志 (-l bin) 的文件格式，log.cpp 写，tools/log_decoder.cpp 读
+// 文件是一串记录，每条记录 = LogRecord 头 + payload；多字节字段都是本机字节序 (解码要在同类机器上做)
+// 调用点第一次执行时登记一次格式串 (SITE 记录)，之后每条日志只记 站点 id + TSC + 参数的原始字节，
+// 不调用 localtime / vsnprintf；时间和文本都留给解码器
+struct LogRecord
+{
+    uint32_t site;      // < FIRST_SITE 是控制记录，否则是登记过的调用点
+    uint32_t size;      // 整条记录的字节数，含这个头
+    uint64_t tsc;       // 写入时的 LogBin::tsc()
+};
+
+class LogBin
+{
+public:
+    // 控制记录
+    static const uint32_t HEADER = 0;       // 每个文件 (每次打开) 的第一条：MAGIC；解码器遇到它清空站点表
+    static const uint32_t CALIBRATE = 1;    // int64 墙上时间 (ns) + double 每纳秒 tick 数，头里的 tsc 与之对应
+    static const uint32_t SITE = 2;         // uint32 id + uint8 级别 + uint8 参数个数 + 参数类型码 + 格式串 (不含 '\0')
+    static const uint32_t TEXT = 3;         // uint8 级别 + 已经格式化好的一行 (非字面量格式串走这里)
+    static const uint32_t DROPPED = 4;      // uint64 丢掉的条数
+    static const uint32_t FIRST_SITE = 16;
+
+    static const size_t MAX_RECORD = 2048;  // 一条日志记录的上限，超长的字符串参数截断
+    static const size_t MAGIC_LEN = 8;
+    static const char *magic() { return "TWSBLOG1"; }
+
+    // 参数类型码：整数都按 8 字节存，字符串是 uint16 长度 + 内容
+    static const char T_INT = 'i';
+    static const char T_UINT = 'u';
+    static const char T_DOUBLE = 'f';
+    static const char T_STR = 's';
+    static const char T_PTR = 'p';
+
+    template <class T>
+    static constexpr char type_code()
+    {
+        return std::is_same<T, char *>::value || std::is_same<T, const char *>::value ? T_STR
+             : std::is_floating_point<T>::value ? T_DOUBLE
+             : std::is_pointer<T>::value ? T_PTR
+             : std::is_enum<T>::value ? T_INT
+             : std::is_integral<T>::value ? (std::is_signed<T>::value ? T_INT : T_UINT)
+             : 0;
+    }
+
+    // 时间戳：x86 上直接读 TSC (约 20 个周期，不进内核)，其它平台退回单调时钟纳秒
+    // 依赖 constant / invariant TSC 且各核同步，近十年的 x86 服务器都满足
+    static inline uint64_t tsc()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+    }
+
+    static const char *level_tag(int level)
+    {
+        switch (level)
+        {
+        case 0: return "[debug]:";
+        case 2: return "[warn]:";
+        case 3: return "[error]:";
+        default: return "[info]:";
+        }
+    }
+
+    // 按参数类型把原始字节追加到 p，空间不够时字符串截断、定长参数省略 (解码器按缺参数处理)
+    template <class T>
+    static void put(char *&p, char *end, const T &v)
+    {
+        typedef typename std::decay<T>::type D;
+        put_as(p, end, v, std::integral_constant<char, type_code<D>()>());
+    }
+
+private:
+    static void put8(char *&p, char *end, const void *v)
+    {
+        if (end - p < 8) return;
+        memcpy(p, v, 8);
+        p += 8;
+    }
+
+    template <class T>
+    static void put_as(char *&p, char *end, const T &v, std::integral_constant<char, T_INT>)
+    {
+        int64_t x = (int64_t)v;
+        put8(p, end, &x);
+    }
+
+    template <class T>
+    static void put_as(char *&p, char *end, const T &v, std::integral_constant<char, T_UINT>)
+    {
+        uint64_t x = (uint64_t)v;
+        put8(p, end, &x);
+    }
+
+    template <class T>
+    static void put_as(char *&p, char *end, const T &v, std::integral_constant<char, T_DOUBLE>)
+    {
+        double x = (double)v;
+        put8(p, end, &x);
+    }
+
+    template <class T>
+    static void put_as(char *&p, char *end, const T &v, std::integral_constant<char, T_PTR>)
+    {
+        uint64_t x = (uint64_t)(uintptr_t)v;
+        put8(p, end, &x);
+    }
+
+    static void put_as(char *&p, char *end, const char *s, std::integral_constant<char, T_STR>)
+    {
+        if (end - p < 2) return;
+        if (!s) s = "(null)";
+        size_t room = end - p - 2;
+        size_t len = strlen(s);
+        if (len > room) len = room;
+        if (len > 0xffff) len = 0xffff;
+        uint16_t n = (uint16_t)len;
+        memcpy(p, &n, 2);
+        memcpy(p + 2, s, len);
+        p += 2 + len;
+    }
+};
+
+#endif
@@ -1,17 +1,30 @@
-#ifndef HEAP_TIMER_H
-#define HEAP_TIMER_H
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
 
-#include <queue>
-#include <deque>
 #include <netinet/in.h>
+#include <stdint.h>
 #include <time.h>
-#include "log.h"
-
-using namespace std;
 
 #define BUFFER_SIZE 64
 
-class util_timer; // 前向声明
+struct client_data; // 前向声明
+
+// 定时器节点：直接嵌在 client_data 里 (client_data 数组按 fd 预先分配，就是定时器节点池)，
+// 用 prev/next 挂在时间轮槽位的双向链表上；加入、刷新、删除都只改几个指针，不分配内存
+struct util_timer
+{
+    util_timer() : prev(nullptr), next(nullptr), expire(0), cb_func(nullptr), user_data(nullptr) {}
+
+    bool pending() const { return prev != nullptr; }   // 是否挂在时间轮上
+
+    util_timer *prev;
+    util_timer *next;
+    int64_t expire;                     // 超时时刻 (timer_now() 的毫秒数)
+
+    // 回调函数
+    void (*cb_func)(client_data *);
+    client_data *user_data;
+};
 
 // 用户数据结构
 struct client_data
@@ -19,230 +32,257 @@ struct client_data
     sockaddr_in address;
     int sockfd;
     char buf[BUFFER_SIZE];
-    util_timer *timer;
+    util_timer timer;
 };
 
-// 定时器类
-class util_timer
+// 定时器用的时钟：单调时钟的毫秒数，不受改系统时间影响，和 timerfd 的 CLOCK_MONOTONIC 是同一个时钟
+// loop 每轮从 epoll_wait 返回后读一次缓存起来，这一轮处理的事件共用，不用每个连接都读一次
+inline int64_t timer_now()
 {
-public:
-    util_timer() : cb_func(NULL), user_data(NULL) {}
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-public:
-    time_t expire; // 超时时间
-    
-    // 回调函数
-    void (*cb_func)(client_data *);
-    client_data *user_data;
-    
-    // 注意：堆实现不需要 prev/next 指针，因为我们用数组存
-};
-
-// 最小堆定时器管理类
-class time_heap
+// 分层时间轮：第 0 层 256 个槽，每槽 1 毫秒；往上每层 64 个槽，每槽是下一层一整圈
+// 定时器按离到期还有多远放进对应的层，第 0 层转完一圈时把上一层的当前槽拆下来重新分配 (cascade)
+// 加入 / 刷新 / 删除都是 O(1)，和连接数无关；每个连接一个节点，不会随请求数增长
+// 每层用位图记录哪些槽非空：tick 跳过空槽，next_expire() 几次位运算就能算出下一个要处理的时刻，
+// loop 据此设置 timerfd，没有到期的定时器就不会被唤醒
+// 每个 Sub-Reactor 一个，只在自己的 loop 线程里访问
+class timer_wheel
 {
 public:
-    // 构造函数：初始化堆大小
-    // capacity: 预估的最大连接数，比如 10000
-    time_heap(int capacity) throw(std::exception) : capacity(capacity), cur_size(0)
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;    // 每层正好 64 个槽，位图是一个 uint64_t
+    static const int LEVELS = 4;        // 第 0 层之上的层数，总跨度 2^32 毫秒 (约 49 天)
+
+    explicit timer_wheel(int64_t now) : m_now(now), m_count(0)
     {
-        array = new util_timer *[capacity]; // 创建指针数组
-        if (!array)
+        for (int i = 0; i < ROOT_SIZE; ++i) init_head(&m_root[i]);
+        for (int l = 0; l < LEVELS; ++l)
         {
-            throw std::exception();
-        }
-        for (int i = 0; i < capacity; ++i)
-        {
-            array[i] = NULL;
+            for (int i = 0; i < LEVEL_SIZE; ++i) init_head(&m_levels[l][i]);
+            m_level_bits[l] = 0;
         }
+        for (int w = 0; w < ROOT_WORDS; ++w) m_root_bits[w] = 0;
     }
-    
-    // 析构函数
-    ~time_heap()
+
+    // 按 timer->expire 加入；已经在轮上的先摘下来
+    void add_timer(util_timer *timer)
     {
-        for (int i = 0; i < cur_size; ++i)
-        {
-            delete array[i];
-        }
-        delete[] array;
+        if (!timer) return;
+        if (timer->pending()) unlink(timer);
+        else ++m_count;
+        place(timer);
     }
 
-    // 添加定时器：O(log N)
-    void add_timer(util_timer *timer)
+    // 连接有活动，把超时时刻推后到 expire
+    void adjust_timer(util_timer *timer, int64_t expire)
     {
         if (!timer) return;
-        
-        if (cur_size >= capacity)
-        {
-            resize(); // 容量不够时扩容
-        }
+        if (timer->pending() && timer->expire == expire) return;
+        timer->expire = expire;
+        add_timer(timer);
+    }
 
-        // 1. 先把新节点放到数组最后
-        int hole = cur_size++;
-        int parent = 0;
-        
-        // 2. 上滤 (Percolate Up)：如果比父节点小，就交换
-        for (; hole > 0; hole = parent)
+    void del_timer(util_timer *timer)
+    {
+        if (!timer || !timer->pending()) return;
+        unlink(timer);
+        --m_count;
+    }
+
+    // 处理到 now 为止 (含) 到期的定时器；回调在节点摘下之后调用，回调里可以重新加入定时器
+    void tick(int64_t now)
+    {
+        while (m_now <= now)
         {
-            parent = (hole - 1) / 2;
-            if (array[parent]->expire <= timer->expire)
+            int idx = (int)(m_now & ROOT_MASK);
+            // 第 0 层转完一圈：上一层的当前槽往下拆，拆出来的是 0 号槽说明那一层也转完了一圈，继续往上
+            if (idx == 0)
+            {
+                for (int l = 0; l < LEVELS; ++l)
+                {
+                    int i = (int)((m_now >> (ROOT_BITS + l * LEVEL_BITS)) & LEVEL_MASK);
+                    cascade(l, i);
+                    if (i != 0) break;
+                }
+            }
+            // 空槽不用逐毫秒走：直接跳到本圈下一个非空槽，本圈没有了就跳到下一圈开头 (那里要 cascade)
+            int next = next_root(idx);
+            if (next != idx)
             {
-                break; 
+                int64_t to = next < 0 ? (m_now | ROOT_MASK) + 1 : m_now + (next - idx);
+                m_now = to < now + 1 ? to : now + 1;
+                continue;
+            }
+            // 先把整个槽摘下来再推进时间：回调里新加的已到期定时器落到下一个槽，不会在这里无限循环
+            util_timer expired;
+            init_head(&expired);
+            splice(&m_root[idx], &expired);
+            m_root_bits[idx >> 6] &= ~(1ULL << (idx & 63));
+            ++m_now;
+            while (expired.next != &expired)
+            {
+                util_timer *timer = expired.next;
+                unlink(timer);
+                --m_count;
+                if (timer->cb_func) timer->cb_func(timer->user_data);
             }
-            array[hole] = array[parent];
         }
-        array[hole] = timer;
     }
 
-    // 删除定时器：惰性删除 O(1)
-    // 我们不真正删除它，只是把它的回调函数设为 NULL
-    // 等到 tick 到它的时候，发现是 NULL 再删
-    void del_timer(util_timer *timer)
+    // 下一次需要 tick 的时刻 (毫秒)：最早到期的定时器，或者更早的一次 cascade；轮上没有定时器返回 -1
+    // 定时器被刷新往后推时这里可能偏早，到点 tick 一次什么也不做，再按新的结果定时即可
+    int64_t next_expire() const
     {
-        if (!timer) return;
-        // 只是把回调置空，并未释放内存，也没有从数组移除
-        timer->cb_func = NULL;
+        if (m_count == 0) return -1;
+        int64_t best = INT64_MAX;
+        int idx = (int)(m_now & ROOT_MASK);
+        int b = next_root(idx);
+        if (b >= 0) best = m_now + (b - idx);
+        // 本圈剩下的槽都空：已经转过的槽里挂的是下一圈的定时器
+        else if ((b = next_root(0)) >= 0) best = (m_now | ROOT_MASK) + 1 + b;
+        // 上面各层：槽 i 在时间走到本层第 i 个边界时 cascade，从当前 (或下一个) 边界开始找第一个非空槽
+        // m_now 正好在边界上时这次 cascade 还没做，拆下来的定时器可能比第 0 层里的都早
+        for (int l = 0; l < LEVELS; ++l)
+        {
+            if (!m_level_bits[l]) continue;
+            int shift = ROOT_BITS + l * LEVEL_BITS;
+            int64_t base = (m_now + (1LL << shift) - 1) >> shift;
+            int start = (int)(base & LEVEL_MASK);
+            uint64_t bits = m_level_bits[l];
+            if (start) bits = (bits >> start) | (bits << (LEVEL_SIZE - start));
+            int64_t t = (base + __builtin_ctzll(bits)) << shift;
+            if (t < best) best = t;
+        }
+        return best;
     }
 
-    // 调整定时器：O(log N)
-    // 通常是因为连接有活动，过期时间延长了，需要往下沉
-    // 调整定时器：策略是“惰性刷新”
-    // 我们找不到旧定时器在堆里的位置，所以直接把它废弃，然后加个新的
-    void adjust_timer(util_timer *timer)
+    int size() const { return m_count; }
+
+private:
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int ROOT_MASK = ROOT_SIZE - 1;
+    static const int ROOT_WORDS = ROOT_SIZE / 64;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int LEVEL_MASK = LEVEL_SIZE - 1;
+    static_assert(LEVEL_SIZE == 64, "level bitmap is one uint64_t");
+
+    static void init_head(util_timer *head)
     {
-        if (!timer) return;
-        
-        // 1. 保存旧定时器的关键信息
-        // 因为我们要把旧的废弃掉，得先把回调函数和用户数据存下来
-        void (*cb_func)(client_data *) = timer->cb_func;
-        client_data *user_data = timer->user_data;
-        
-        // 2. 【核心步骤】废弃旧定时器
-        // 将回调置空，tick() 遍历到它时会直接跳过并删除
-        // 注意：这里不要 delete timer，因为它的指针还在堆数组里，delete了会导致堆数组里有悬空指针！
-        // 内存释放交给 tick() 的 pop_timer() 去做。
-        timer->cb_func = NULL;
-        
-        // 3. 创建新定时器
-        util_timer *new_timer = new util_timer;
-        new_timer->user_data = user_data;
-        new_timer->cb_func = cb_func;
-        
-        // 4. 设置新的超时时间 (当前时间 + 3倍的时间槽)
-        // TIMESLOT 需要你在头部定义，比如 #define TIMESLOT 5
-        new_timer->expire = time(NULL) + 3 * 5; 
-
-        // 5. 【关键】更新用户数据中的指针
-        // 这一点非常重要！否则下次有数据来，找到的还是旧的 timer
-        user_data->timer = new_timer;
-
-        // 6. 加入堆
-        add_timer(new_timer);
+        head->prev = head->next = head;
     }
 
-    // 获取堆顶
-    util_timer *top() const
+    static void link(util_timer *head, util_timer *timer)
     {
-        if (cur_size == 0) return NULL;
-        return array[0];
+        timer->prev = head->prev;
+        timer->next = head;
+        head->prev->next = timer;
+        head->prev = timer;
     }
 
-    // 删除堆顶
-    void pop_timer()
+    // 摘下节点；它所在的槽因此变空时清掉位图里对应的位 (tick / cascade 用的临时链表不在轮上，不用管)
+    void unlink(util_timer *timer)
     {
-        if (cur_size == 0) return;
-        if (array[0])
+        util_timer *prev = timer->prev;
+        prev->next = timer->next;
+        timer->next->prev = prev;
+        timer->prev = timer->next = nullptr;
+        if (prev->next != prev) return;
+        if (prev >= m_root && prev < m_root + ROOT_SIZE)
         {
-            delete array[0];
-            array[0] = NULL;
+            int i = (int)(prev - m_root);
+            m_root_bits[i >> 6] &= ~(1ULL << (i & 63));
         }
-        
-        // 1. 把最后一个元素移到堆顶
-        array[0] = array[--cur_size];
-        
-        // 2. 下滤 (Percolate Down)
-        int hole = 0;
-        int child = 0;
-        util_timer *temp = array[0];
-        
-        for (; hole * 2 + 1 < cur_size; hole = child)
+        else if (prev >= &m_levels[0][0] && prev < &m_levels[0][0] + LEVELS * LEVEL_SIZE)
         {
-            child = hole * 2 + 1;
-            // 找左右孩子里更小的那个
-            if ((child < cur_size - 1) && (array[child + 1]->expire < array[child]->expire))
-            {
-                child++;
-            }
-            if (array[child]->expire < temp->expire)
-            {
-                array[hole] = array[child];
-            }
-            else
-            {
-                break;
-            }
+            int i = (int)(prev - &m_levels[0][0]);
+            m_level_bits[i / LEVEL_SIZE] &= ~(1ULL << (i % LEVEL_SIZE));
+        }
+    }
+
+    // 把 from 链表整个接到 to 的尾部，from 变空
+    static void splice(util_timer *from, util_timer *to)
+    {
+        if (from->next == from) return;
+        from->next->prev = to->prev;
+        to->prev->next = from->next;
+        from->prev->next = to;
+        to->prev = from->prev;
+        init_head(from);
+    }
+
+    void link_root(int i, util_timer *timer)
+    {
+        link(&m_root[i], timer);
+        m_root_bits[i >> 6] |= 1ULL << (i & 63);
+    }
+
+    // 第 0 层从 idx 开始 (含) 第一个非空槽，本圈剩下的都空返回 -1
+    int next_root(int idx) const
+    {
+        int w = idx >> 6;
+        uint64_t bits = m_root_bits[w] & (~0ULL << (idx & 63));
+        while (true)
+        {
+            if (bits) return (w << 6) + __builtin_ctzll(bits);
+            if (++w == ROOT_WORDS) return -1;
+            bits = m_root_bits[w];
         }
-        array[hole] = temp;
     }
 
-    // 心跳函数：处理过期连接
-    void tick()
+    // 按离到期的距离选槽：已经过期的放进下一个要处理的槽；超出总跨度的放在最远处，转到了再重新分配
+    void place(util_timer *timer)
     {
-        util_timer *tmp = array[0];
-        time_t cur = time(NULL);
-        
-        while (cur_size > 0)
+        int64_t expire = timer->expire;
+        int64_t delta = expire - m_now;
+        if (delta < 0)
         {
-            if (!tmp) break;
-            
-            // 如果堆顶的 expire 大于当前时间，说明堆里剩下的都没过期（最小堆性质）
-            if (tmp->expire > cur)
-            {
-                break;
-            }
-            
-            // 【核心处理】
-            // 如果 cb_func 是 NULL，说明这个定时器之前被 adjust_timer 废弃了
-            // 我们什么都不做，直接把它 pop 掉（惰性删除在这里真正生效）
-            if (array[0]->cb_func)
+            link_root((int)(m_now & ROOT_MASK), timer);
+            return;
+        }
+        if (delta < ROOT_SIZE)
+        {
+            link_root((int)(expire & ROOT_MASK), timer);
+            return;
+        }
+        const int64_t max_delta = (1LL << (ROOT_BITS + LEVELS * LEVEL_BITS)) - 1;
+        if (delta > max_delta) expire = m_now + max_delta;
+        for (int l = 0; l < LEVELS; ++l)
+        {
+            if (delta < (1LL << (ROOT_BITS + (l + 1) * LEVEL_BITS)) || l == LEVELS - 1)
             {
-                // 只有活着的定时器才执行回调
-                array[0]->cb_func(array[0]->user_data);
+                int i = (int)((expire >> (ROOT_BITS + l * LEVEL_BITS)) & LEVEL_MASK);
+                link(&m_levels[l][i], timer);
+                m_level_bits[l] |= 1ULL << i;
+                return;
             }
-            
-            // 弹出堆顶（这里会 delete 掉旧的 timer 内存）
-            pop_timer();
-            
-            // 重置 tmp 指向新的堆顶
-            tmp = array[0];
         }
     }
-    
-    bool empty() const { return cur_size == 0; }
 
-private:
-    // 数组扩容：容量翻倍
-    void resize()
+    void cascade(int level, int i)
     {
-        util_timer **temp = new util_timer *[2 * capacity];
-        for (int i = 0; i < 2 * capacity; ++i)
-        {
-            temp[i] = NULL;
-        }
-        if (!temp) throw std::exception();
-        
-        capacity = 2 * capacity;
-        for (int i = 0; i < cur_size; ++i)
+        if (!(m_level_bits[level] & (1ULL << i))) return;
+        util_timer list;
+        init_head(&list);
+        splice(&m_levels[level][i], &list);
+        m_level_bits[level] &= ~(1ULL << i);
+        while (list.next != &list)
         {
-            temp[i] = array[i];
+            util_timer *timer = list.next;
+            unlink(timer);
+            place(timer);
         }
-        delete[] array;
-        array = temp;
     }
 
-    util_timer **array; // 堆数组
-    int capacity;       // 堆容量
-    int cur_size;       // 当前元素个数
+    int64_t m_now;                      // 下一个要处理的毫秒
+    int m_count;                        // 挂在轮上的定时器数
+    uint64_t m_root_bits[ROOT_WORDS];   // 各层非空槽的位图
+    uint64_t m_level_bits[LEVELS];
+    util_timer m_root[ROOT_SIZE];       // 各槽链表的哨兵节点
+    util_timer m_levels[LEVELS][LEVEL_SIZE];
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,210 +1,830 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <pthread.h>
 #include <assert.h>
 #include <errno.h>
+#include <getopt.h>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <mutex>
 #include "ThreadPool.h"
 #include "http_conn.h"
 #include "sql_conn_pool.h"
 #include "log.h"
 #include "lst_timer.h"
+#include "cpu_topology.h"
+#ifdef USE_IO_URING
+#include <poll.h>
+#include "uring.h"
+#endif
 
 const int MAX_EVENTS = 10000;
 const int MAX_FD = 1000;//这是为了测试文件上传功能，webbench压力测试时请改回65536
-const int TIMESLOT = 5; // 最小超时单位：5秒
+const int PORT = 8080;
+const int SUB_REACTOR_NUM = 0; // Sub-Reactor (事件循环线程) 数量，0 表示按 CPU 核数自动决定
+const int WORKER_NUM = 0;      // 线程池 worker 数量，0 表示按 CPU 核数自动决定
+const int DEFER_ACCEPT_SECONDS = 5; // TCP_DEFER_ACCEPT：客户端发来首包数据后才唤醒 accept
+const unsigned URING_ENTRIES = 4096;  // io_uring 后端每个 loop 的 SQ 大小
 
-static int pipefd[2];           // 管道：0读，1写
-static time_heap timer_lst(10000);//初始化最小堆，容量 10000
-static int epoll_fd = 0;
-static HttpConn* users = nullptr; // 全局指针
+// loop 间通知消息 (主线程 -> Sub-Reactor)
+const char NOTIFY_STOP = 'Q';   // 优雅退出
 
-// 信号处理函数
-void sig_handler(int sig) {
-    int save_errno = errno;
-    int msg = sig;
-    send(pipefd[1], (char*)&msg, 1, 0); // 往管道写信号
-    errno = save_errno;
-}
+static HttpConn* users = nullptr; // 全局指针 (按 fd 索引，fd 全进程唯一，各 loop 只访问自己 accept 的那部分)
+static client_data* users_timer = nullptr;
 
-// 设置信号函数
-void addsig(int sig) {
-    struct sigaction sa;
-    memset(&sa, '\0', sizeof(sa));
-    sa.sa_handler = sig_handler;
-    sa.sa_flags |= SA_RESTART;
-    sigfillset(&sa.sa_mask);
-    sigaction(sig, &sa, NULL);
-}
+// Sub-Reactor：one loop per thread
+// 每个 loop 独占 epoll 实例、SO_REUSEPORT 监听 socket 和定时器堆，彼此之间没有共享的可变状态，
+// 内核负责把新连接均衡到各个监听 socket 上
+struct SubReactor {
+    int id;
+    int epoll_fd;
+    int listen_fd;
+    int idle_fd;          // 预留的空闲 fd：进程 fd 耗尽 (EMFILE) 时腾出来 accept 再立即关闭
+    int notify_fd[2];     // socketpair：主线程写 [1]，本 loop 读 [0]
+    timer_wheel timer_lst;   // 本 loop 的连接超时 (定时器节点嵌在 users_timer 里)
+    int timer_fd;            // 定到时间轮下一个要处理的时刻，到点可读
+    int64_t armed;           // timer_fd 当前定的时刻，-1 表示没定或已经触发
+    int64_t now;             // 本轮循环缓存的 timer_now()，这一轮的刷新超时都用它
+    std::thread thread;
+    int cpu;                  // 绑定的 CPU，-1 表示不绑核
+    vector<size_t> home;      // 和本 loop 共享 L3 的 worker：本 loop 派发的任务只交给它们
+    int event_fd;                       // worker -> loop 的唤醒 eventfd
+    std::mutex pending_mtx;
+    vector<pair<int, int>> pending;     // worker 处理完交还的 (fd, EPOLLIN/EPOLLOUT)
+    ThreadPool* pool;
+
+#ifdef USE_IO_URING
+    IoUring ring;
+    uint64_t event_buf;
+    char notify_buf[64];
+    vector<unsigned> gen;               // 每个 fd 的代数：丢弃已关闭连接迟到的完成事件
+    vector<struct iovec> iovs;          // 每个 fd 在飞的 sendmsg 所用的 iovec (MAX_IOV 个一组)
+    vector<struct msghdr> msgs;         // 每个 fd 在飞的 sendmsg 的 msghdr
+#endif
 
-// 定时器回调函数：删除非活动连接
+    SubReactor(int id) : id(id), epoll_fd(-1), listen_fd(-1), idle_fd(-1), timer_lst(timer_now()),
+                         timer_fd(-1), armed(-1), now(timer_now()), cpu(-1),
+                         event_fd(-1), pool(nullptr) {
+        notify_fd[0] = notify_fd[1] = -1;
+    }
+};
+
+// 定时器回调函数：删除超时 (卡住不动或收发太慢) 的连接
+// 由连接所属的 loop 线程调用，close_conn 内部使用该连接自己的 epoll fd；io_uring 后端用 uring_cb_func
 void cb_func(client_data* user_data) {
     if (!user_data) return;
-    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, user_data->sockfd, 0);
-    close(user_data->sockfd);
-    HttpConn::m_user_count--;
-    LOG_INFO("Kick Client (Timeout): fd=%d", user_data->sockfd);
+    HttpConn& conn = users[user_data->sockfd];
+    LOG_INFO("Kick Client (Timeout, %s): fd=%d", conn.phase_name(), user_data->sockfd);
+    conn.close_conn();
 }
 
-int main() {
-    // 1. 初始化日志 (开启全量日志模式)
-    Log::Instance()->init("./log/ServerLog", 0, 2000, 800000, 800);
-    
-    // 2. 初始化数据库
-    SqlConnPool::Instance()->init("localhost", 3306, "tiny", "123456", "webserver", 8);
-
-    // 3. 忽略 SIGPIPE
-    signal(SIGPIPE, SIG_IGN);
+// 创建开启 SO_REUSEPORT 的监听 socket，每个 Sub-Reactor 各绑定一个
+// cpu >= 0 时设置 SO_INCOMING_CPU：内核优先把在该 CPU 上收到的新连接交给这个 socket，
+// 连接的软中断、accept 和后续收发落在同一个核上
+int create_listen_socket(int port, int cpu) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) return -1;
 
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    // 只建立了三次握手、还没发请求的连接先留在内核里，不占用 HttpConn 和定时器
+    int defer = DEFER_ACCEPT_SECONDS;
+    setsockopt(listen_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(defer));
+    if (cpu >= 0) setsockopt(listen_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
 
     sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(8080);
-    
-    bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
-    listen(server_fd, 10000);
-
-    epoll_fd = epoll_create1(0);
-    HttpConn::m_epollfd = epoll_fd;
-
-    // 添加 server_fd 到 epoll (函数定义已在 http_conn.cpp 中)
-    addfd(epoll_fd, server_fd, false);
-    
-    // 创建管道
-    socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
-    setnonblocking(pipefd[1]); // 写端非阻塞
-    addfd(epoll_fd, pipefd[0], false); // 读端加入 epoll
-
-    // 设置信号
-    addsig(SIGALRM); // 定时信号
-    addsig(SIGTERM); // kill 信号
-    addsig(SIGINT);  // Ctrl+C 信号 (用于优雅退出检测内存)
-    alarm(TIMESLOT); // 开启闹钟
-
-    ThreadPool pool(4);
-    users = new HttpConn[MAX_FD];
-    users->initmysql_result(SqlConnPool::Instance());
-    client_data *users_timer = new client_data[MAX_FD];
+    server_addr.sin_port = htons(port);
+
+    if (bind(listen_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 ||
+        listen(listen_fd, 10000) < 0) {
+        close(listen_fd);
+        return -1;
+    }
+    return listen_fd;
+}
+
+// 过载时直接回一个 503 并关闭，让客户端尽快失败/重试，而不是挂在 backlog 里
+void reject_conn(int connfd) {
+    static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                               "Content-Length: 0\r\nConnection: close\r\n\r\n";
+    send(connfd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    close(connfd);
+}
+
+// 新连接：初始化 HttpConn 并绑定定时器
+void add_conn(SubReactor* r, int connfd, const sockaddr_in& client_addr) {
+    users[connfd].init(connfd, client_addr, r->epoll_fd, r);
+
+    // 绑定定时器
+    users_timer[connfd].address = client_addr;
+    users_timer[connfd].sockfd = connfd;
+
+    util_timer *timer = &users_timer[connfd].timer;
+    timer->user_data = &users_timer[connfd];
+    timer->cb_func = cb_func;
+    timer->expire = users[connfd].deadline(r->now); // 新连接先按收请求头计时
+    r->timer_lst.add_timer(timer);
+}
+
+// fd 耗尽时的降级：释放预留 fd，把一个连接 accept 出来立刻关掉，再把预留 fd 占回来
+// 返回是否成功腾出了一个连接
+bool shed_with_idle_fd(SubReactor* r) {
+    LOG_WARN("Accept EMFILE: shed connection (Sub-Reactor %d)", r->id);
+    if (r->idle_fd >= 0) {
+        close(r->idle_fd);
+        r->idle_fd = -1;
+    }
+    int fd = accept(r->listen_fd, NULL, NULL);
+    if (fd >= 0) reject_conn(fd);
+    r->idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return fd >= 0;
+}
+
+// accept 阶段：监听 socket 是 ET 模式，必须一直 accept 到 EAGAIN，
+// 否则突发连接会卡在 backlog 里等下一次边沿
+void handle_accept(SubReactor* r) {
+    while (true) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int connfd = accept4(r->listen_fd, (struct sockaddr*)&client_addr, &client_len,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (connfd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                // fd 耗尽：连接留在 backlog 里会让 ET 事件再也不触发 (或 LT 下空转)
+                if (!shed_with_idle_fd(r)) break;
+                continue;
+            }
+            LOG_ERROR("Accept Failure: errno=%d", errno);
+            break;
+        }
+
+        // 连接数达到上限 (或 fd 超出连接表范围)：准入控制，拒绝新连接
+        if (HttpConn::m_user_count >= MAX_FD || connfd >= MAX_FD) {
+            reject_conn(connfd);
+            continue;
+        }
+
+        add_conn(r, connfd, client_addr);
+    }
+}
+
+// loop 线程启动时调用：绑核，并让本 loop 派发的任务只交给同一 cache 域里的 worker
+void place_loop(SubReactor* r, ThreadPool* pool) {
+    if (r->cpu < 0) return;
+    CpuTopology* topo = CpuTopology::Instance();
+    for (const CpuTopology::Cpu& c : topo->cpus()) {
+        if (c.id != r->cpu) continue;
+        if (!topo->pin(c)) LOG_WARN("Sub-Reactor %d: pin to cpu %d failed", r->id, r->cpu);
+        break;
+    }
+    pool->set_home(r->home);
+}
+
+// 进入 epoll_wait / io_uring_enter 前调用：把 timer_fd 定到时间轮下一个要处理的时刻 (CLOCK_MONOTONIC 绝对时间)
+// 只在出现更早的到期、或上次定的已经触发时才调 timerfd_settime；连接刷新把到期往后推不动 timerfd，
+// 到点 tick 一次发现没有到期的，再按新的结果定一次
+void arm_timer(SubReactor* r) {
+    int64_t next = r->timer_lst.next_expire();
+    if (next < 0 || (r->armed >= 0 && r->armed <= next)) return;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000;
+    its.it_value.tv_nsec = (next % 1000) * 1000000;
+    if (timerfd_settime(r->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0) r->armed = next;
+}
+
+// 按连接当前阶段重新计时 (不在时间轮上的定时器顺便挂回去)
+// 算出的期限已经过了 (比如收发太慢，按最低速率算的期限早就到了) 就不等下一次 tick，当场按超时踢掉并返回 false
+bool refresh_timer(SubReactor* r, int fd) {
+    util_timer *timer = &users_timer[fd].timer;
+    int64_t expire = users[fd].deadline(r->now);
+    if (expire <= r->now) {
+        r->timer_lst.del_timer(timer);
+        timer->cb_func(timer->user_data);
+        return false;
+    }
+    r->timer_lst.adjust_timer(timer, expire);
+    return true;
+}
+
+// 把连接交给 worker：worker 持有期间 loop 不能关它 (关掉会把 worker 正在解析的缓冲区还给 BufferPool，
+// worker 交还时还要对这个 fd 重新挂起事件)，所以先把定时器摘下来，交还时再按新阶段挂回去
+void dispatch(SubReactor* r, int fd) {
+    r->timer_lst.del_timer(&users_timer[fd].timer);
+    r->pool->enqueue([fd] {
+        users[fd].process();
+    });
+}
+
+// HttpConn::s_rearm_hook：worker 线程调用，把连接交还给所属 loop
+void loop_rearm(void* loop, int fd, int ev) {
+    SubReactor* r = (SubReactor*)loop;
+    {
+        lock_guard<std::mutex> locker(r->pending_mtx);
+        r->pending.emplace_back(fd, ev);
+    }
+    uint64_t one = 1;
+    ssize_t ret = ::write(r->event_fd, &one, sizeof(one));
+    (void)ret;
+}
+
+// 取出 worker 交还的连接
+vector<pair<int, int>> take_pending(SubReactor* r) {
+    vector<pair<int, int>> pending;
+    lock_guard<std::mutex> locker(r->pending_mtx);
+    pending.swap(r->pending);
+    return pending;
+}
+
+// 便宜的请求 (内存里已缓存的小静态文件 GET) 在 loop 线程就地处理：省掉交给线程池的两次线程切换；
+// 响应排好后当场发送，不用先 EPOLL_CTL_MOD 成 EPOLLOUT 再等一轮 epoll_wait
+void serve_inline(SubReactor* r, int sockfd) {
+    int ev = users[sockfd].handle_requests();
+    int state = ev < 0 ? -1 : 0;
+    if (ev == EPOLLIN) modfd(r->epoll_fd, sockfd, EPOLLIN);
+    else if (ev == EPOLLOUT) state = users[sockfd].write();
+    util_timer *timer = &users_timer[sockfd].timer;
+    if (state < 0) {
+        r->timer_lst.del_timer(timer);
+        users[sockfd].close_conn();
+        return;
+    }
+    // 响应发完进入空闲 / 没发完进入发送阶段，超时跟着换
+    if (!refresh_timer(r, sockfd)) return;
+    if (state == 2) dispatch(r, sockfd);
+}
 
+// Sub-Reactor 事件循环：accept、读写事件分发、定时器 tick 都在本线程完成
+void run_sub_reactor(SubReactor* r, ThreadPool* pool) {
+    timer_wheel& timer_lst = r->timer_lst;
     struct epoll_event events[MAX_EVENTS];
     bool timeout = false;
-    bool stop_server = false;
+    bool stop_loop = false;
+    r->pool = pool;
 
-    LOG_INFO("Server Start with Timer System...");
+    place_loop(r, pool);
+    LOG_INFO("Sub-Reactor %d Start: epoll_fd=%d listen_fd=%d cpu=%d", r->id, r->epoll_fd, r->listen_fd, r->cpu);
+
+    while (!stop_loop) {
+        arm_timer(r);
+        int n = epoll_wait(r->epoll_fd, events, MAX_EVENTS, -1);
 
-    while (!stop_server) {
-        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
-        
         if (n < 0 && errno != EINTR) {
-            LOG_ERROR("Epoll Failure");
+            LOG_ERROR("Epoll Failure (Sub-Reactor %d)", r->id);
             break;
         }
+        r->now = timer_now();
 
         for (int i = 0; i < n; i++) {
             int sockfd = events[i].data.fd;
 
             // 1. 新连接
-            if (sockfd == server_fd) {
-                struct sockaddr_in client_addr;
-                socklen_t client_len = sizeof(client_addr);
-                int connfd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-                
-                if (connfd < 0) continue;
-                if (HttpConn::m_user_count >= MAX_FD) {
-                    close(connfd);
-                    continue;
-                }
-                
-                users[connfd].init(connfd, client_addr);
-
-                // 绑定定时器
-                users_timer[connfd].address = client_addr;
-                users_timer[connfd].sockfd = connfd;
-                
-                util_timer *timer = new util_timer;
-                timer->user_data = &users_timer[connfd];
-                timer->cb_func = cb_func;
-                time_t cur = time(NULL);
-                timer->expire = cur + 3 * TIMESLOT; // 15s 后过期
-                
-                users_timer[connfd].timer = timer;
-                timer_lst.add_timer(timer);
+            if (sockfd == r->listen_fd) {
+                handle_accept(r);
+            }
+            // 2. 时间轮的下一个到期时刻到了
+            else if (sockfd == r->timer_fd) {
+                uint64_t expirations;
+                ssize_t ret = read(r->timer_fd, &expirations, sizeof(expirations));
+                (void)ret;
+                r->armed = -1;
+                timeout = true;
             }
-            // 2. 处理信号 (管道读端)
-            else if ((sockfd == pipefd[0]) && (events[i].events & EPOLLIN)) {
-                char signals[1024];
-                int ret = recv(pipefd[0], signals, sizeof(signals), 0);
+            // 3. 主线程的通知 (退出)
+            else if ((sockfd == r->notify_fd[0]) && (events[i].events & EPOLLIN)) {
+                char msgs[1024];
+                int ret = recv(r->notify_fd[0], msgs, sizeof(msgs), 0);
                 if (ret <= 0) continue;
-                else {
-                    for (int i = 0; i < ret; ++i) {
-                        switch (signals[i]) {
-                            case SIGALRM:
-                                timeout = true;
-                                break;
-                            case SIGTERM:
-                            case SIGINT: // 处理 Ctrl+C
-                                stop_server = true;
-                                break;
-                        }
-                    }
+                for (int j = 0; j < ret; ++j) {
+                    if (msgs[j] == NOTIFY_STOP) stop_loop = true;
+                }
+            }
+            // 4. worker 处理完毕：挂回定时器，重新注册读 / 写事件
+            else if (sockfd == r->event_fd) {
+                uint64_t cnt;
+                ssize_t ret = read(r->event_fd, &cnt, sizeof(cnt));
+                (void)ret;
+                for (auto& p : take_pending(r)) {
+                    if (refresh_timer(r, p.first)) modfd(r->epoll_fd, p.first, p.second);
                 }
             }
-            // 3. 读事件
+            // 5. 读事件
             else if (events[i].events & EPOLLIN) {
-                util_timer *timer = users_timer[sockfd].timer;
+                util_timer *timer = &users_timer[sockfd].timer;
                 if (users[sockfd].read_once()) {
-                    if (timer) {
-                        timer_lst.adjust_timer(timer); 
+                    if (!refresh_timer(r, sockfd)) continue;
+
+                    // 只有要查库、上传、读磁盘的请求才交给线程池
+                    if (users[sockfd].cheap_request()) {
+                        serve_inline(r, sockfd);
+                    } else {
+                        dispatch(r, sockfd);
                     }
-                    
-                    pool.enqueue([sockfd] {
-                        users[sockfd].process();
-                    });
                 } else {
                     // 读失败，关闭连接
-                    if (timer) timer_lst.del_timer(timer);
+                    timer_lst.del_timer(timer);
                     users[sockfd].close_conn();
                 }
             }
-            // 4. 写事件
+            // 6. 写事件
             else if (events[i].events & EPOLLOUT) {
-                util_timer *timer = users_timer[sockfd].timer;
-                if (users[sockfd].write()) {
-                    if (timer) {
-                        timer_lst.adjust_timer(timer);
-                    }
+                util_timer *timer = &users_timer[sockfd].timer;
+                int state = users[sockfd].write();
+                if (state >= 0) {
+                    if (!refresh_timer(r, sockfd)) continue;
+                    // 流水线里还有已经读进来的请求：不会再有 EPOLLIN，直接派发
+                    if (state == 2) dispatch(r, sockfd);
                 } else {
-                    if (timer) timer_lst.del_timer(timer);
+                    timer_lst.del_timer(timer);
                     users[sockfd].close_conn();
                 }
             }
-            // 5. 异常
+            // 7. 异常
             else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                util_timer *timer = users_timer[sockfd].timer;
-                if (timer) timer_lst.del_timer(timer);
+                util_timer *timer = &users_timer[sockfd].timer;
+                timer_lst.del_timer(timer);
                 users[sockfd].close_conn();
             }
         }
 
         if (timeout) {
-            timer_lst.tick();
-            alarm(TIMESLOT);
+            timer_lst.tick(r->now);
+            timeout = false;
+        }
+    }
+
+    LOG_INFO("Sub-Reactor %d Stop", r->id);
+}
+
+#ifdef USE_IO_URING
+// ======================= io_uring 后端 =======================
+// accept / recv / writev / close 全部以 SQE 形式提交，每轮循环只进入内核一次 (io_uring_enter)
+// 连接上同一时刻最多只有一个 recv 或 writev 在飞，相当于 epoll 后端的 EPOLLONESHOT
+enum UringOp { OP_ACCEPT = 1, OP_RECV, OP_WRITE, OP_POLLOUT, OP_POLLIN, OP_NOTIFY, OP_EVENT, OP_CLOSE, OP_TIMER };
+
+static inline uint64_t uring_data(int op, unsigned gen, int fd) {
+    return ((uint64_t)op << 56) | ((uint64_t)(gen & 0xffffff) << 32) | (uint32_t)fd;
+}
+
+void uring_close_conn(SubReactor* r, int fd);
+void uring_write_state(SubReactor* r, int fd, int state);
+
+// io_uring 后端的超时回调：必须走 uring_close_conn，先把代数加一再异步关 fd。
+// 直接 close 的话，还挂在 ring 里的 recv 会带着没变的代数以 0 完成，再关一次时 fd 可能已经被新连接复用
+void uring_cb_func(client_data* user_data) {
+    if (!user_data) return;
+    int fd = user_data->sockfd;
+    LOG_INFO("Kick Client (Timeout, %s): fd=%d", users[fd].phase_name(), fd);
+    uring_close_conn((SubReactor*)users[fd].loop(), fd);
+}
+
+void uring_submit_recv(SubReactor* r, int fd) {
+    // 上传内容由 worker 直接从 socket splice 进文件：这里只等可读，不提交 recv
+    if (users[fd].direct_read()) {
+        r->ring.prep_poll(fd, POLLIN, uring_data(OP_POLLIN, r->gen[fd], fd));
+        return;
+    }
+    char* buf;
+    int len;
+    if (!users[fd].read_space(&buf, &len)) {
+        uring_close_conn(r, fd);
+        return;
+    }
+    r->ring.prep_recv(fd, buf, len, uring_data(OP_RECV, r->gen[fd], fd));
+}
+
+// 发送响应：队列头部是内存段时提交 sendmsg (即 writev)；是文件段时在 loop 线程里非阻塞 sendfile，
+// 发不动 (或本轮预算用完) 再让 ring 等 POLLOUT
+void uring_submit_write(SubReactor* r, int fd) {
+    struct iovec* iov = &r->iovs[fd * HttpConn::MAX_IOV];
+    bool file_follows = false;
+    int cnt = users[fd].write_iov(iov, HttpConn::MAX_IOV, &file_follows);
+    if (cnt > 0) {
+        struct msghdr* msg = &r->msgs[fd];
+        memset(msg, 0, sizeof(*msg));
+        msg->msg_iov = iov;
+        msg->msg_iovlen = cnt;
+        r->ring.prep_sendmsg(fd, msg, MSG_NOSIGNAL | (file_follows ? MSG_MORE : 0),
+                             uring_data(OP_WRITE, r->gen[fd], fd));
+        return;
+    }
+
+    int state;
+    switch (users[fd].send_some()) {
+        case HttpConn::SEND_DONE:
+            state = users[fd].write_done(0);
+            break;
+        case HttpConn::SEND_AGAIN:
+        case HttpConn::SEND_YIELD:
+            r->ring.prep_poll(fd, POLLOUT, uring_data(OP_POLLOUT, r->gen[fd], fd));
+            return;
+        default:
+            state = -1;
+            break;
+    }
+    uring_write_state(r, fd, state);
+}
+
+// 根据 write_done() 的结果推进连接：继续写 / 继续读 / 派发流水线请求 / 关闭
+void uring_write_state(SubReactor* r, int fd, int state) {
+    if (state < 0) {
+        uring_close_conn(r, fd);
+    } else if (state == 1) {
+        uring_submit_write(r, fd);
+    } else if (state == 2) {
+        dispatch(r, fd);
+    } else {
+        uring_submit_recv(r, fd);
+    }
+}
+
+// 便宜的请求在 loop 线程就地处理，响应直接提交发送，不经过 worker -> eventfd -> loop 的交还
+void uring_serve_inline(SubReactor* r, int fd) {
+    int ev = users[fd].handle_requests();
+    if (ev < 0) {
+        uring_close_conn(r, fd);
+        return;
+    }
+    if (!refresh_timer(r, fd)) return;
+    if (ev == EPOLLOUT) uring_submit_write(r, fd);
+    else uring_submit_recv(r, fd);
+}
+
+// loop 线程内关闭连接：状态立即回收，fd 通过 ring 异步 shutdown + close
+void uring_close_conn(SubReactor* r, int fd) {
+    util_timer *timer = &users_timer[fd].timer;
+    r->timer_lst.del_timer(timer);
+    users[fd].close_conn(false);
+    r->ring.prep_shutdown_close(fd, uring_data(OP_CLOSE, r->gen[fd], fd));
+    r->gen[fd]++;
+}
+
+void uring_handle_accept(SubReactor* r, int connfd) {
+    if (HttpConn::m_user_count >= MAX_FD || connfd >= MAX_FD) {
+        reject_conn(connfd);
+        return;
+    }
+    // multishot accept 共享一个地址缓冲区，批量完成时会被覆盖，这里不取对端地址
+    sockaddr_in client_addr;
+    memset(&client_addr, 0, sizeof(client_addr));
+    r->gen[connfd]++;
+    users[connfd].init(connfd, client_addr, -1, r);
+
+    users_timer[connfd].address = client_addr;
+    users_timer[connfd].sockfd = connfd;
+    util_timer *timer = &users_timer[connfd].timer;
+    timer->user_data = &users_timer[connfd];
+    timer->cb_func = uring_cb_func;
+    timer->expire = users[connfd].deadline(r->now); // 新连接先按收请求头计时
+    r->timer_lst.add_timer(timer);
+
+    uring_submit_recv(r, connfd);
+}
+
+void run_uring_reactor(SubReactor* r, ThreadPool* pool) {
+    IoUring& ring = r->ring;
+    r->pool = pool;
+    bool timeout = false;
+    bool stop_loop = false;
+
+    ring.prep_accept(r->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC, true, uring_data(OP_ACCEPT, 0, r->listen_fd));
+    ring.prep_read(r->notify_fd[0], r->notify_buf, sizeof(r->notify_buf), uring_data(OP_NOTIFY, 0, r->notify_fd[0]));
+    ring.prep_read(r->event_fd, &r->event_buf, sizeof(r->event_buf), uring_data(OP_EVENT, 0, r->event_fd));
+    ring.prep_poll(r->timer_fd, POLLIN, uring_data(OP_TIMER, 0, r->timer_fd));
+
+    place_loop(r, pool);
+    LOG_INFO("Sub-Reactor %d Start (io_uring): listen_fd=%d cpu=%d", r->id, r->listen_fd, r->cpu);
+
+    while (!stop_loop) {
+        // 提交本轮积攒的所有 SQE 并等待完成事件：一次系统调用
+        arm_timer(r);
+        if (ring.submit(1) < 0 && errno != EINTR && errno != EBUSY) {
+            LOG_ERROR("io_uring_enter Failure (Sub-Reactor %d): errno=%d", r->id, errno);
+            break;
+        }
+        r->now = timer_now();
+
+        ring.for_each_cqe([&](uint64_t data, int res, unsigned flags) {
+            int op = data >> 56;
+            unsigned gen = (data >> 32) & 0xffffff;
+            int fd = (int)(uint32_t)data;
+
+            switch (op) {
+                // 1. 新连接 (multishot：内核不再续期时重新提交)
+                case OP_ACCEPT:
+                    if (res >= 0) {
+                        uring_handle_accept(r, res);
+                    } else if (res == -EMFILE || res == -ENFILE) {
+                        while (shed_with_idle_fd(r)) {}
+                    }
+                    if (!(flags & IORING_CQE_F_MORE)) {
+                        ring.prep_accept(r->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC, true, data);
+                    }
+                    break;
+                // 2. 主线程的通知 (退出)
+                case OP_NOTIFY:
+                    for (int j = 0; j < res; ++j) {
+                        if (r->notify_buf[j] == NOTIFY_STOP) stop_loop = true;
+                    }
+                    ring.prep_read(r->notify_fd[0], r->notify_buf, sizeof(r->notify_buf), data);
+                    break;
+                // 3. 时间轮的下一个到期时刻到了
+                // timer_fd 是非阻塞的 (和 epoll 后端一样创建)，直接提交 READ 在有的内核上会立刻以 -EAGAIN 完成、
+                // 让循环空转；所以只 POLL_ADD 等它可读，再在这里读掉计数。出错的完成 (-ECANCELED 等) 不算到期
+                case OP_TIMER:
+                    if (res > 0) {
+                        uint64_t expirations;
+                        if (read(r->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                            r->armed = -1;
+                            timeout = true;
+                        }
+                    }
+                    ring.prep_poll(r->timer_fd, POLLIN, data);
+                    break;
+                // 4. worker 处理完毕，继续读请求或发送响应
+                case OP_EVENT: {
+                    for (auto& p : take_pending(r)) {
+                        // 交给 worker 时摘下的定时器挂回去；worker 可能推进了阶段 (请求头收全、响应排好)，按新阶段计时
+                        if (!refresh_timer(r, p.first)) continue;
+                        if (p.second & EPOLLOUT) uring_submit_write(r, p.first);
+                        else uring_submit_recv(r, p.first);
+                    }
+                    ring.prep_read(r->event_fd, &r->event_buf, sizeof(r->event_buf), data);
+                    break;
+                }
+                // 5. 读完成：便宜的请求就地处理，其余交给线程池解析
+                case OP_RECV: {
+                    if (gen != (r->gen[fd] & 0xffffff)) break; // 连接已关闭，迟到的完成事件
+                    if (res <= 0) {
+                        uring_close_conn(r, fd);
+                        break;
+                    }
+                    users[fd].read_done(res);
+                    if (!refresh_timer(r, fd)) break;
+                    if (users[fd].cheap_request()) {
+                        uring_serve_inline(r, fd);
+                        break;
+                    }
+                    dispatch(r, fd);
+                    break;
+                }
+                // 6. 写完成：没写完继续写，长连接继续读，否则关闭
+                case OP_WRITE: {
+                    if (gen != (r->gen[fd] & 0xffffff)) break;
+                    int state = res < 0 ? -1 : users[fd].write_done(res);
+                    if (state < 0) {
+                        uring_close_conn(r, fd);
+                        break;
+                    }
+                    if (!refresh_timer(r, fd)) break;
+                    uring_write_state(r, fd, state);
+                    break;
+                }
+                // 7. 文件段发送时 socket 重新可写
+                case OP_POLLOUT:
+                    if (gen != (r->gen[fd] & 0xffffff)) break;
+                    if (res < 0 || (res & (POLLERR | POLLHUP))) {
+                        uring_close_conn(r, fd);
+                        break;
+                    }
+                    uring_submit_write(r, fd);
+                    break;
+                // 8. splice 上传时 socket 重新可读 (对端关闭也交给 worker，它 peek 到 0 字节会关连接)
+                case OP_POLLIN: {
+                    if (gen != (r->gen[fd] & 0xffffff)) break;
+                    if (res < 0) {
+                        uring_close_conn(r, fd);
+                        break;
+                    }
+                    dispatch(r, fd);
+                    break;
+                }
+                default:
+                    break;
+            }
+        });
+
+        if (timeout) {
+            r->timer_lst.tick(r->now);
             timeout = false;
         }
     }
-    
-    // 优雅退出后的资源清理
-    close(epoll_fd);
-    close(server_fd);
-    close(pipefd[1]);
-    close(pipefd[0]);
+
+    LOG_INFO("Sub-Reactor %d Stop", r->id);
+}
+#endif
+
+// 向所有 Sub-Reactor 广播一条通知
+void notify_all(vector<unique_ptr<SubReactor>>& reactors, char msg) {
+    for (auto& r : reactors) {
+        send(r->notify_fd[1], &msg, 1, 0);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // 命令行：-b epoll|uring 选择 IO 后端，-t N 指定 Sub-Reactor 数量，-w N 指定 worker 数量，
+    // -s N 指定 worker 睡眠前空转轮数，-a 0 关闭绑核，
+    // -o H,B,I,W 指定收请求头 / 收请求体 / 长连接空闲 / 发响应四个阶段的超时 (毫秒，可以只给前几个)，
+    // -r R[,W] 指定收请求和发响应的最低速率 (字节/秒，0 表示不检查；只给一个时两者相同)，
+    // -l bin 写二进制日志 (用 log_decoder 还原成文本)
+    bool use_uring = false;
+    int loop_num = SUB_REACTOR_NUM;
+    int worker_num = WORKER_NUM;
+    int spin_rounds = ThreadPool::SPIN_ROUNDS;
+    bool pin_threads = true;
+    bool binary_log = false;
+    int opt;
+    HttpConn::Timeouts& to = HttpConn::s_timeouts;
+    while ((opt = getopt(argc, argv, "b:t:w:s:a:o:r:l:")) != -1) {
+        switch (opt) {
+            case 'b': use_uring = (strcmp(optarg, "uring") == 0); break;
+            case 't': loop_num = atoi(optarg); break;
+            case 'w': worker_num = atoi(optarg); break;
+            case 's': spin_rounds = atoi(optarg); break;
+            case 'a': pin_threads = atoi(optarg) != 0; break;
+            case 'o': sscanf(optarg, "%d,%d,%d,%d", &to.header, &to.body, &to.idle, &to.write); break;
+            case 'r':
+                if (sscanf(optarg, "%d,%d", &to.min_read_rate, &to.min_write_rate) == 1) {
+                    to.min_write_rate = to.min_read_rate;
+                }
+                break;
+            case 'l': binary_log = (strcmp(optarg, "bin") == 0); break;
+            default: break;
+        }
+    }
+
+    // SIGTERM / SIGINT 在创建任何线程 (日志、线程池、loop) 之前屏蔽，屏蔽字被所有线程继承：
+    // 信号不会打断任何线程里的系统调用，只由主线程从 signalfd 读出来
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    // 1. 初始化日志 (开启全量日志模式)
+    Log::Instance()->init("./log/ServerLog", 0, 2000, 800000, 800, binary_log);
+
+    // 2. 初始化数据库
+    SqlConnPool::Instance()->init("localhost", 3306, "tiny", "123456", "webserver", 8);
+
+    LOG_INFO("HTTP scanner: %s", HttpScan::name());
+    LOG_INFO("Timeouts (ms): header=%d body=%d idle=%d write=%d; min rate (B/s): read=%d write=%d",
+             to.header, to.body, to.idle, to.write, to.min_read_rate, to.min_write_rate);
+
+    // 静态文件缓存：inotify 监听资源目录，文件改动后自动失效
+    if (!FileCache::Instance()->init(doc_root)) {
+        LOG_WARN("inotify on %s failed, static file cache disabled", doc_root);
+    }
+
+    // 3. 忽略 SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    // 线程数默认跟着本进程可用的 CPU 走：每个 CPU 一个 loop、一个 worker，按拓扑顺序绑核，
+    // 第 i 个 loop 和第 i 个 worker 在同一个核上，loop 派发的任务留在自己的 cache 域里
+    CpuTopology* topo = CpuTopology::Instance();
+    int cpu_num = (int)topo->cpus().size();
+    if (loop_num <= 0) loop_num = cpu_num;
+    if (worker_num <= 0) worker_num = cpu_num;
+    LOG_INFO("CPU topology: %d cpus, %d NUMA nodes; %d loops, %d workers, pinning %s",
+             cpu_num, topo->node_count(), loop_num, worker_num, pin_threads ? "on" : "off");
+
+    ThreadPool pool(worker_num, spin_rounds, [topo, pin_threads](size_t i) {
+        if (pin_threads) topo->pin(topo->cpu_for(i));
+    });
+    users = new HttpConn[MAX_FD];
+    users->initmysql_result(SqlConnPool::Instance());
+    users_timer = new client_data[MAX_FD];
+    HttpConn::s_rearm_hook = loop_rearm;
+
+#ifndef USE_IO_URING
+    if (use_uring) {
+        LOG_WARN("io_uring backend not compiled in (USE_IO_URING=OFF), fallback to epoll");
+        use_uring = false;
+    }
+#endif
+
+    // 4. 创建 Sub-Reactor：各自的 epoll + SO_REUSEPORT 监听 socket + 通知管道
+    vector<unique_ptr<SubReactor>> reactors;
+    for (int i = 0; i < loop_num; ++i) {
+        unique_ptr<SubReactor> r(new SubReactor(i));
+        if (pin_threads) {
+            const CpuTopology::Cpu& cpu = topo->cpu_for(i);
+            r->cpu = cpu.id;
+            for (int j = 0; j < worker_num; ++j) {
+                const CpuTopology::Cpu& w = topo->cpu_for(j);
+                if (w.node == cpu.node && w.llc == cpu.llc) r->home.push_back(j);
+            }
+        }
+        r->listen_fd = create_listen_socket(PORT, r->cpu);
+        if (r->listen_fd < 0) {
+            LOG_ERROR("Create Listen Socket Failure: errno=%d", errno);
+            return 1;
+        }
+        r->idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        socketpair(PF_UNIX, SOCK_STREAM, 0, r->notify_fd);
+        setnonblocking(r->notify_fd[1]);
+        r->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (r->timer_fd < 0) {
+            LOG_ERROR("timerfd_create Failure: errno=%d", errno);
+            return 1;
+        }
+        // io_uring 直接提交 READ 读它，要阻塞的；epoll 后端 ET 读一次就清零
+        r->event_fd = eventfd(0, EFD_CLOEXEC | (use_uring ? 0 : EFD_NONBLOCK));
+
+#ifdef USE_IO_URING
+        if (use_uring) {
+            if (!r->ring.init(URING_ENTRIES)) {
+                LOG_ERROR("io_uring_setup Failure: errno=%d", errno);
+                return 1;
+            }
+            r->gen.assign(MAX_FD, 0);
+            r->iovs.resize(MAX_FD * HttpConn::MAX_IOV);
+            r->msgs.resize(MAX_FD);
+            reactors.push_back(std::move(r));
+            continue;
+        }
+#endif
+        r->epoll_fd = epoll_create1(0);
+        addfd(r->epoll_fd, r->listen_fd, false);
+        addfd(r->epoll_fd, r->notify_fd[0], false);
+        addfd(r->epoll_fd, r->timer_fd, false);
+        addfd(r->epoll_fd, r->event_fd, false);
+        reactors.push_back(std::move(r));
+    }
+
+    // 5. 主线程只负责信号：SIGTERM / SIGINT 从 signalfd 读出 (已在所有线程里屏蔽)
+    int main_epoll_fd = epoll_create1(0);
+    int sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    addfd(main_epoll_fd, sig_fd, false);
+
+    for (auto& r : reactors) {
+#ifdef USE_IO_URING
+        if (use_uring) {
+            r->thread = std::thread(run_uring_reactor, r.get(), &pool);
+            continue;
+        }
+#endif
+        r->thread = std::thread(run_sub_reactor, r.get(), &pool);
+    }
+
+    LOG_INFO("Server Start with %d Sub-Reactors (%s)...", loop_num, use_uring ? "io_uring" : "epoll");
+
+    struct epoll_event events[8];
+    bool stop_server = false;
+
+    while (!stop_server) {
+        int n = epoll_wait(main_epoll_fd, events, 8, -1);
+
+        if (n < 0 && errno != EINTR) {
+            LOG_ERROR("Epoll Failure");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            // 处理信号：signalfd 是 ET 模式，读到 EAGAIN 为止
+            if ((events[i].data.fd == sig_fd) && (events[i].events & EPOLLIN)) {
+                struct signalfd_siginfo si;
+                while (read(sig_fd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGTERM || si.ssi_signo == SIGINT) { // 包括 Ctrl+C
+                        stop_server = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // 优雅退出：先停掉所有 loop，再等 worker 执行完已经入队的任务 (任务会访问 users 并交还给 loop)，最后回收资源
+    notify_all(reactors, NOTIFY_STOP);
+    for (auto& r : reactors) r->thread.join();
+    pool.shutdown();
+    for (auto& r : reactors) {
+        if (r->epoll_fd >= 0) close(r->epoll_fd);
+        close(r->event_fd);
+        close(r->listen_fd);
+        if (r->idle_fd >= 0) close(r->idle_fd);
+        close(r->notify_fd[0]);
+        close(r->notify_fd[1]);
+        close(r->timer_fd);
+    }
+    close(main_epoll_fd);
+    close(sig_fd);
     delete[] users;
     delete[] users_timer;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,202 @@
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <atomic>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// 线程池任务：只能移动的 void() 可调用对象
+// 捕获不超过 INLINE_SIZE 字节 (比如 [sockfd] / [fd]) 直接放在对象内部，构造、移动都不碰堆；
+// 更大的可调用对象才 new 一份放在堆上。比 std::function 少一层拷贝语义，也不需要可拷贝
+class Task {
+public:
+    static const size_t INLINE_SIZE = 32;   // 加上 ops 指针共 48 字节 (按 16 字节对齐)，再加队列槽位的序号正好一个 cache line
+
+    Task() noexcept : m_ops(nullptr) {}
+
+    template<class F, class D = typename std::decay<F>::type,
+             class = typename std::enable_if<!std::is_same<D, Task>::value>::type>
+    Task(F&& f) : m_ops(nullptr) {
+        typedef typename std::conditional<fits_inline<D>(), Inline<D>, Heap<D>>::type Impl;
+        Impl::create(m_buf, std::forward<F>(f));
+        m_ops = &Impl::ops;
+    }
+
+    Task(Task&& other) noexcept : m_ops(other.m_ops) {
+        if (m_ops) {
+            m_ops->move(m_buf, other.m_buf);
+            other.m_ops = nullptr;
+        }
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.m_ops) {
+                other.m_ops->move(m_buf, other.m_buf);
+                m_ops = other.m_ops;
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    void reset() {
+        if (m_ops) {
+            m_ops->destroy(m_buf);
+            m_ops = nullptr;
+        }
+    }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    void operator()() { m_ops->invoke(m_buf); }
+
+private:
+    struct Ops {
+        void (*invoke)(void* buf);
+        void (*move)(void* dst, void* src);   // 把 src 的内容移到 dst 并析构 src
+        void (*destroy)(void* buf);
+    };
+
+    template<class D>
+    static constexpr bool fits_inline() {
+        return sizeof(D) <= INLINE_SIZE && alignof(D) <= alignof(max_align_t) &&
+               std::is_nothrow_move_constructible<D>::value;
+    }
+
+    template<class D>
+    struct Inline {
+        template<class F>
+        static void create(void* buf, F&& f) { new (buf) D(std::forward<F>(f)); }
+        static void invoke(void* buf) { (*static_cast<D*>(buf))(); }
+        static void move(void* dst, void* src) {
+            new (dst) D(std::move(*static_cast<D*>(src)));
+            static_cast<D*>(src)->~D();
+        }
+        static void destroy(void* buf) { static_cast<D*>(buf)->~D(); }
+        static const Ops ops;
+    };
+
+    // 放不下的可调用对象：缓冲区里只存一个指针
+    template<class D>
+    struct Heap {
+        template<class F>
+        static void create(void* buf, F&& f) { *static_cast<D**>(buf) = new D(std::forward<F>(f)); }
+        static void invoke(void* buf) { (**static_cast<D**>(buf))(); }
+        static void move(void* dst, void* src) { *static_cast<D**>(dst) = *static_cast<D**>(src); }
+        static void destroy(void* buf) { delete *static_cast<D**>(buf); }
+        static const Ops ops;
+    };
+
+    alignas(max_align_t) unsigned char m_buf[INLINE_SIZE];
+    const Ops* m_ops;
+};
+
+// MpmcQueue 槽位 = 序号 (按 Task 的对齐补齐) + Task，要放进一个 cache line
+static_assert(alignof(Task) + sizeof(Task) <= 64, "Task slot must fit in one cache line");
+
+template<class D> const Task::Ops Task::Inline<D>::ops = { &Inline<D>::invoke, &Inline<D>::move, &Inline<D>::destroy };
+template<class D> const Task::Ops Task::Heap<D>::ops = { &Heap<D>::invoke, &Heap<D>::move, &Heap<D>::destroy };
+
+// 有界多生产者多消费者无锁环形队列 (Dmitry Vyukov 的 MPMC 队列)
+// 每个槽位带一个序号：序号 == 位置 表示可写，序号 == 位置 + 1 表示可读；
+// 生产者、消费者各自 CAS 一个下标抢位置，抢到后只读写自己的槽位，一次出入队只碰两三个 cache line
+// 容量必须是 2 的幂；满了 push 返回 false，空了 pop 返回 false，都不阻塞
+template<class T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity) : m_mask(capacity - 1) {
+        void* mem = nullptr;
+        if (posix_memalign(&mem, CACHE_LINE, sizeof(Cell) * capacity) != 0) throw std::bad_alloc();
+        m_cells = static_cast<Cell*>(mem);
+        for (size_t i = 0; i < capacity; ++i) {
+            new (&m_cells[i]) Cell;
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+    }
+
+    ~MpmcQueue() {
+        for (size_t i = 0; i <= m_mask; ++i) m_cells[i].~Cell();
+        free(m_cells);
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool push(T&& v) {
+        Cell* cell;
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;                          // 满了
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(v);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& v) {
+        Cell* cell;
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;                          // 空了 (或生产者抢到位置还没写完)
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+        v = std::move(cell->data);
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 近似判断：抢到位置还没写完的元素也算非空，调用方据此决定要不要睡眠
+    bool empty() const {
+        return m_head.load(std::memory_order_seq_cst) == m_tail.load(std::memory_order_seq_cst);
+    }
+
+private:
+    static const size_t CACHE_LINE = 64;
+
+    struct alignas(CACHE_LINE) Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    // 生产者和消费者的下标用填充隔开，避免伪共享
+    // (不用 alignas：C++14 的 new 不保证超过 16 字节的对齐，队列对象本身可能被 new 出来)
+    Cell* m_cells;
+    const size_t m_mask;
+    char m_pad0[CACHE_LINE];
+    std::atomic<size_t> m_head;
+    char m_pad1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_tail;
+    char m_pad2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+#endif
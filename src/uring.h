@@ -0,0 +1,199 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+// 极简 io_uring 封装：直接走 io_uring_setup / io_uring_enter 系统调用，不依赖 liburing
+// 只在所属 loop 线程内使用，不需要加锁
+class IoUring {
+public:
+    IoUring() : m_ring_fd(-1), m_sq_ptr(nullptr), m_cq_ptr(nullptr), m_sqes(nullptr),
+                m_sq_size(0), m_cq_size(0), m_sqe_size(0), m_to_submit(0) {}
+
+    ~IoUring() {
+        if (m_sqes) munmap(m_sqes, m_sqe_size);
+        if (m_cq_ptr && m_cq_ptr != m_sq_ptr) munmap(m_cq_ptr, m_cq_size);
+        if (m_sq_ptr) munmap(m_sq_ptr, m_sq_size);
+        if (m_ring_fd >= 0) close(m_ring_fd);
+    }
+
+    // 创建 ring 并映射 SQ/CQ 环形队列，失败返回 false (比如内核不支持)
+    bool init(unsigned entries) {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        m_ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+        if (m_ring_fd < 0) return false;
+
+        m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            if (m_cq_size > m_sq_size) m_sq_size = m_cq_size;
+            m_cq_size = m_sq_size;
+        }
+
+        m_sq_ptr = mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_ring_fd, IORING_OFF_SQ_RING);
+        if (m_sq_ptr == MAP_FAILED) { m_sq_ptr = nullptr; return false; }
+        if (single_mmap) {
+            m_cq_ptr = m_sq_ptr;
+        } else {
+            m_cq_ptr = mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            m_ring_fd, IORING_OFF_CQ_RING);
+            if (m_cq_ptr == MAP_FAILED) { m_cq_ptr = nullptr; return false; }
+        }
+        m_sqe_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        m_sqes = (struct io_uring_sqe*)mmap(0, m_sqe_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+        if (m_sqes == MAP_FAILED) { m_sqes = nullptr; return false; }
+
+        char* sq = (char*)m_sq_ptr;
+        m_sq_head = (unsigned*)(sq + p.sq_off.head);
+        m_sq_tail = (unsigned*)(sq + p.sq_off.tail);
+        m_sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+        m_sq_entries = *(unsigned*)(sq + p.sq_off.ring_entries);
+        m_sq_array = (unsigned*)(sq + p.sq_off.array);
+
+        char* cq = (char*)m_cq_ptr;
+        m_cq_head = (unsigned*)(cq + p.cq_off.head);
+        m_cq_tail = (unsigned*)(cq + p.cq_off.tail);
+        m_cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+        m_cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    // 取一个空闲 SQE；SQ 满了就先把已有的提交掉
+    struct io_uring_sqe* get_sqe() {
+        unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        unsigned tail = *m_sq_tail;
+        if (tail - head >= m_sq_entries) {
+            submit(0);
+            head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+            if (tail - head >= m_sq_entries) return nullptr;
+        }
+        unsigned idx = tail & m_sq_mask;
+        struct io_uring_sqe* sqe = &m_sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        m_sq_array[idx] = idx;
+        __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++m_to_submit;
+        return sqe;
+    }
+
+    // 一次系统调用提交本轮积攒的全部 SQE，并等待至少 wait_nr 个完成事件
+    int submit(unsigned wait_nr) {
+        unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+        int ret = syscall(__NR_io_uring_enter, m_ring_fd, m_to_submit, wait_nr, flags, NULL, 0);
+        if (ret >= 0) m_to_submit -= (unsigned)ret > m_to_submit ? m_to_submit : ret;
+        return ret;
+    }
+
+    // 遍历所有已完成的 CQE，回调 f(user_data, res, flags)
+    template<class F>
+    unsigned for_each_cqe(F f) {
+        unsigned head = *m_cq_head;
+        unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            struct io_uring_cqe* cqe = &m_cqes[head & m_cq_mask];
+            f(cqe->user_data, cqe->res, cqe->flags);
+        }
+        __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    // ---------------- 各类操作的 SQE 填充 ----------------
+    bool prep_accept(int fd, struct sockaddr* addr, socklen_t* len, int flags, bool multishot, uint64_t data) {
+        struct io_uring_sqe* sqe = prep(IORING_OP_ACCEPT, fd, data);
+        if (!sqe) return false;
+        sqe->addr = (uint64_t)(uintptr_t)addr;
+        sqe->addr2 = (uint64_t)(uintptr_t)len;
+        sqe->accept_flags = flags;
+        if (multishot) sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+        return true;
+    }
+
+    bool prep_recv(int fd, void* buf, unsigned len, uint64_t data) {
+        struct io_uring_sqe* sqe = prep(IORING_OP_RECV, fd, data);
+        if (!sqe) return false;
+        sqe->addr = (uint64_t)(uintptr_t)buf;
+        sqe->len = len;
+        return true;
+    }
+
+    bool prep_read(int fd, void* buf, unsigned len, uint64_t data) {
+        struct io_uring_sqe* sqe = prep(IORING_OP_READ, fd, data);
+        if (!sqe) return false;
+        sqe->addr = (uint64_t)(uintptr_t)buf;
+        sqe->len = len;
+        sqe->off = (uint64_t)-1; // 不可 seek 的 fd (socket/eventfd) 使用当前位置
+        return true;
+    }
+
+    // 相当于带 flags 的 writev：flags 里可以带 MSG_MORE，让响应头和随后 sendfile 的文件合并发送
+    bool prep_sendmsg(int fd, const struct msghdr* msg, unsigned flags, uint64_t data) {
+        struct io_uring_sqe* sqe = prep(IORING_OP_SENDMSG, fd, data);
+        if (!sqe) return false;
+        sqe->addr = (uint64_t)(uintptr_t)msg;
+        sqe->len = 1;
+        sqe->msg_flags = flags;
+        return true;
+    }
+
+    bool prep_poll(int fd, unsigned poll_mask, uint64_t data) {
+        struct io_uring_sqe* sqe = prep(IORING_OP_POLL_ADD, fd, data);
+        if (!sqe) return false;
+        sqe->poll32_events = poll_mask;
+        return true;
+    }
+
+    // shutdown 与 close 链接提交：shutdown 让该 fd 上挂起的 recv 立即完成，再真正关闭
+    bool prep_shutdown_close(int fd, uint64_t data) {
+        struct io_uring_sqe* sqe = prep(IORING_OP_SHUTDOWN, fd, data);
+        if (!sqe) return false;
+        sqe->len = SHUT_RDWR;
+        sqe->flags |= IOSQE_IO_HARDLINK; // shutdown 失败 (比如对端已断开) 也要继续 close
+        sqe = prep(IORING_OP_CLOSE, fd, data);
+        return sqe != nullptr;
+    }
+
+private:
+    struct io_uring_sqe* prep(int op, int fd, uint64_t data) {
+        struct io_uring_sqe* sqe = get_sqe();
+        if (!sqe) return nullptr;
+        sqe->opcode = op;
+        sqe->fd = fd;
+        sqe->user_data = data;
+        return sqe;
+    }
+
+    int m_ring_fd;
+    void* m_sq_ptr;
+    void* m_cq_ptr;
+    struct io_uring_sqe* m_sqes;
+    size_t m_sq_size;
+    size_t m_cq_size;
+    size_t m_sqe_size;
+    unsigned m_to_submit;   // 已填充但尚未提交给内核的 SQE 数
+
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned* m_sq_array;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned m_cq_mask;
+    struct io_uring_cqe* m_cqes;
+};
+
+#endif
@@ -0,0 +1,315 @@
+// 二进制日志解码器：把 -l bin 写出的 log/*_ServerLog 还原成和文本日志一样的格式，输出到 stdout
+// 用法：log_decoder 文件...   (多个文件按给出的顺序依次解码，比如按 .1 .2 切分出来的文件)
+// 文件格式见 src/log_binary.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "log_binary.h"
+
+using namespace std;
+
+struct Site
+{
+    int level;
+    string types;
+    string format;
+};
+
+struct Arg
+{
+    char type;
+    int64_t i;
+    double f;
+    string s;
+};
+
+class Decoder
+{
+public:
+    Decoder() : m_cal_tsc(0), m_cal_ns(0), m_ticks_per_ns(1.0), m_sec(-1) {}
+
+    bool decode(const char *path)
+    {
+        FILE *fp = fopen(path, "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "log_decoder: cannot open %s\n", path);
+            return false;
+        }
+        vector<char> buf;
+        char chunk[1 << 16];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) buf.insert(buf.end(), chunk, chunk + n);
+        fclose(fp);
+
+        // 同一天里文本模式和二进制模式的进程都写过同一个文件时，跳过不是二进制记录的部分
+        size_t pos = resync(buf, 0);
+        if (pos == buf.size())
+        {
+            fprintf(stderr, "log_decoder: %s is not a binary log\n", path);
+            return false;
+        }
+        if (pos > 0)
+        {
+            fprintf(stderr, "log_decoder: %s: skipped %zu bytes before offset %zu\n", path, pos, pos);
+        }
+        while (pos + sizeof(LogRecord) <= buf.size())
+        {
+            LogRecord rec;
+            memcpy(&rec, &buf[pos], sizeof(rec));
+            if (rec.size < sizeof(rec) || pos + rec.size > buf.size())
+            {
+                size_t next = resync(buf, pos + 1);
+                fprintf(stderr, "log_decoder: %s: bad record at offset %zu, skipped %zu bytes\n", path, pos, next - pos);
+                pos = next;
+                continue;
+            }
+            record(rec, &buf[pos] + sizeof(rec), rec.size - sizeof(rec));
+            pos += rec.size;
+        }
+        if (pos != buf.size())
+        {
+            fprintf(stderr, "log_decoder: %s: truncated record at offset %zu\n", path, pos);
+        }
+        return true;
+    }
+
+private:
+    // 从 from 开始找下一条 HEADER 记录，找不到返回 buf.size()
+    static size_t resync(const vector<char> &buf, size_t from)
+    {
+        const size_t hdr = sizeof(LogRecord) + LogBin::MAGIC_LEN;
+        for (size_t pos = from; pos + hdr <= buf.size(); ++pos)
+        {
+            const char *m = (const char *)memchr(&buf[pos + sizeof(LogRecord)], LogBin::magic()[0],
+                                                 buf.size() - pos - sizeof(LogRecord));
+            if (!m) break;
+            pos = m - buf.data() - sizeof(LogRecord);
+            if (pos + hdr > buf.size()) break;
+            LogRecord rec;
+            memcpy(&rec, &buf[pos], sizeof(rec));
+            if (rec.site == LogBin::HEADER && rec.size == hdr && memcmp(m, LogBin::magic(), LogBin::MAGIC_LEN) == 0)
+            {
+                return pos;
+            }
+        }
+        return buf.size();
+    }
+
+    void record(const LogRecord &rec, const char *p, size_t len)
+    {
+        switch (rec.site)
+        {
+        case LogBin::HEADER:
+            m_sites.clear();    // 新进程 (或新文件) 从头登记
+            break;
+        case LogBin::CALIBRATE:
+            if (len >= 16)
+            {
+                m_cal_tsc = rec.tsc;
+                memcpy(&m_cal_ns, p, 8);
+                memcpy(&m_ticks_per_ns, p + 8, 8);
+            }
+            break;
+        case LogBin::SITE:
+            if (len >= 6)
+            {
+                uint32_t id;
+                memcpy(&id, p, 4);
+                size_t nargs = (unsigned char)p[5];
+                if (6 + nargs > len) break;
+                Site &site = m_sites[id];
+                site.level = p[4];
+                site.types.assign(p + 6, nargs);
+                site.format.assign(p + 6 + nargs, len - 6 - nargs);
+            }
+            break;
+        case LogBin::TEXT:
+            if (len >= 1)
+            {
+                line(rec.tsc, p[0], string(p + 1, len - 1));
+            }
+            break;
+        case LogBin::DROPPED:
+            if (len >= 8)
+            {
+                uint64_t cnt;
+                memcpy(&cnt, p, 8);
+                char msg[64];
+                snprintf(msg, sizeof(msg), "log stage full, %llu lines dropped", (unsigned long long)cnt);
+                line(rec.tsc, 2, msg);
+            }
+            break;
+        default:
+        {
+            auto it = m_sites.find(rec.site);
+            if (it == m_sites.end())
+            {
+                char msg[64];
+                snprintf(msg, sizeof(msg), "<unknown log site %u>", rec.site);
+                line(rec.tsc, 3, msg);
+                break;
+            }
+            line(rec.tsc, it->second.level, render(it->second, p, len));
+        }
+        }
+    }
+
+    // 和文本日志同样的前缀："2024-01-31 12:00:00.123456 [info]: "
+    void line(uint64_t tsc, int level, const string &msg)
+    {
+        int64_t ns = m_cal_ns + (int64_t)((double)(int64_t)(tsc - m_cal_tsc) / m_ticks_per_ns);
+        time_t sec = ns / 1000000000LL;
+        long usec = (long)(ns % 1000000000LL / 1000);
+        if (sec != m_sec)
+        {
+            m_sec = sec;
+            struct tm tm;
+            localtime_r(&sec, &tm);
+            snprintf(m_date, sizeof(m_date), "%d-%02d-%02d %02d:%02d:%02d",
+                     tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        }
+        printf("%s.%06ld %s %s\n", m_date, usec, LogBin::level_tag(level), msg.c_str());
+    }
+
+    static vector<Arg> read_args(const Site &site, const char *p, size_t len)
+    {
+        vector<Arg> args;
+        const char *end = p + len;
+        for (char t : site.types)
+        {
+            Arg a;
+            a.type = t;
+            a.i = 0;
+            a.f = 0;
+            if (t == LogBin::T_STR)
+            {
+                uint16_t n;
+                if (end - p < 2) break;
+                memcpy(&n, p, 2);
+                if (end - p - 2 < n) break;
+                a.s.assign(p + 2, n);
+                p += 2 + n;
+            }
+            else
+            {
+                if (end - p < 8) break;
+                if (t == LogBin::T_DOUBLE) memcpy(&a.f, p, 8);
+                else memcpy(&a.i, p, 8);
+                p += 8;
+            }
+            args.push_back(a);
+        }
+        return args;
+    }
+
+    // 逐个转换说明符格式化：去掉长度修饰符，按记录下来的参数类型重新选 ll / double / 字符串
+    static string render(const Site &site, const char *p, size_t len)
+    {
+        vector<Arg> args = read_args(site, p, len);
+        size_t next = 0;
+        string out;
+        const string &fmt = site.format;
+        for (size_t i = 0; i < fmt.size();)
+        {
+            if (fmt[i] != '%')
+            {
+                out += fmt[i++];
+                continue;
+            }
+            if (i + 1 < fmt.size() && fmt[i + 1] == '%')
+            {
+                out += '%';
+                i += 2;
+                continue;
+            }
+            string spec = "%";
+            size_t j = i + 1;
+            vector<int> stars;      // 宽度 / 精度写成 * 的，各消耗一个整数参数
+            while (j < fmt.size() && strchr("-+ #0123456789.*", fmt[j]))
+            {
+                if (fmt[j] == '*')
+                {
+                    stars.push_back(next < args.size() ? (int)args[next].i : 0);
+                    ++next;
+                }
+                spec += fmt[j++];
+            }
+            while (j < fmt.size() && strchr("hlLqjzt", fmt[j])) ++j;
+            if (j >= fmt.size()) break;
+            char conv = fmt[j];
+            i = j + 1;
+            if (next >= args.size())
+            {
+                out += "<missing>";
+                continue;
+            }
+            const Arg &a = args[next++];
+            char buf[512];
+            int w1 = stars.size() > 0 ? stars[0] : 0, w2 = stars.size() > 1 ? stars[1] : 0;
+            if (strchr("diouxXc", conv) && (a.type == LogBin::T_INT || a.type == LogBin::T_UINT))
+            {
+                spec += conv == 'c' ? "c" : string("ll") + conv;
+                if (conv == 'c') format(buf, sizeof(buf), spec, stars.size(), w1, w2, (int)a.i);
+                else format(buf, sizeof(buf), spec, stars.size(), w1, w2, (long long)a.i);
+            }
+            else if (strchr("fFeEgGaA", conv) && a.type == LogBin::T_DOUBLE)
+            {
+                spec += conv;
+                format(buf, sizeof(buf), spec, stars.size(), w1, w2, a.f);
+            }
+            else if (conv == 's' && a.type == LogBin::T_STR)
+            {
+                spec += conv;
+                format(buf, sizeof(buf), spec, stars.size(), w1, w2, a.s.c_str());
+            }
+            else if (conv == 'p' && (a.type == LogBin::T_PTR || a.type == LogBin::T_UINT))
+            {
+                spec += conv;
+                format(buf, sizeof(buf), spec, stars.size(), w1, w2, (void *)(uintptr_t)a.i);
+            }
+            else
+            {
+                snprintf(buf, sizeof(buf), "<bad %%%c>", conv);
+            }
+            out += buf;
+        }
+        return out;
+    }
+
+    template <class T>
+    static void format(char *buf, size_t size, const string &spec, size_t stars, int w1, int w2, T v)
+    {
+        if (stars == 0) snprintf(buf, size, spec.c_str(), v);
+        else if (stars == 1) snprintf(buf, size, spec.c_str(), w1, v);
+        else snprintf(buf, size, spec.c_str(), w1, w2, v);
+    }
+
+    unordered_map<uint32_t, Site> m_sites;
+    uint64_t m_cal_tsc;
+    int64_t m_cal_ns;
+    double m_ticks_per_ns;
+    time_t m_sec;
+    char m_date[64];
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s log/2024_01_31_ServerLog [more files...]\n", argv[0]);
+        return 1;
+    }
+    Decoder decoder;
+    int ret = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!decoder.decode(argv[i])) ret = 1;
+    }
+    return ret;
+}